@@ -9,7 +9,8 @@
  *
  * In order to reduce the power consumption, the Atmega328P of the UnoEVS
  * is set to sleep between the measurements. A signal change on the
- * SPI slave select pin triggers the wake up of the controller.
+ * SPI slave select pin triggers the wake up of the controller, as well as
+ * the INT pin of the LTR303ALS01 when light events are enabled.
  *
  *  Created on: Oct 18, 2016
  *      Author: E. Mittermeier, BlueberryE
@@ -26,6 +27,46 @@
 #define greenLedOn PORTB |= (1<<PB0)
 #define greenLedOff PORTB &= ~(1<<PB0)
 
+// layout of the frame returned by cmdGetFrame, all values MSB first
+#define FRAME_TEMPERATURE 0  // int32_t, 0.01 degC
+#define FRAME_PRESSURE 4     // uint32_t, Pa
+#define FRAME_HUMIDITY 8     // uint32_t, 1/1024 %RH
+#define FRAME_LUX 12         // uint32_t, 0.01 lx
+#define FRAME_UV 16          // uint16_t, adc level
+#define FRAME_SUPPLY 18      // uint16_t, mV
+#define FRAME_MCU_TEMPERATURE 20 // int16_t, 0.1 degC
+#define FRAME_STATUS 22      // uint8_t, FRAME_STATUS_xxx
+#define FRAME_SEQUENCE 23    // uint16_t, incremented with each cmdMeasureAll
+#define FRAME_CRC 25         // uint16_t, CRC-16/XMODEM of the bytes 0 .. 24
+#define FRAME_SIZE 27
+
+// status bits
+#define FRAME_STATUS_BME280 0x01 // the BME280 values are valid
+#define FRAME_STATUS_LTR303 0x02 // the LTR303ALS01 values are valid
+#define FRAME_STATUS_ML8511 0x04 // the ML8511 value is valid
+#define FRAME_STATUS_MCU 0x08    // supply voltage and MCU temperature are valid
+#define FRAME_STATUS_BUSY 0x80   // a measurement is running, the values are from the previous one
+
+// number of ADC conversions averaged for the UV level
+#define ML8511_CONVERSIONS 3
+
+// the LTR303ALS01 is polled while it changes its range, at most two
+// measurement periods of the slowest range
+#define LTR303_POLL_MS 10
+#define LTR303_RANGING_TIMEOUT_MS 1200
+
+// light events: the thresholds of the LTR303ALS01 are armed around the last
+// value of channel 0, at least this number of counts apart
+#define LIGHT_EVENT_MIN_DELTA 4
+// number of consecutive values out of the thresholds - 1 until an event
+#define LIGHT_EVENT_PERSIST 1
+
+// the states of the sensor tasks in measureAll()
+#define TASK_START 0
+#define TASK_WAIT 1
+#define TASK_READ 2
+#define TASK_DONE 3
+
 extern "C" {
     #include <avr/io.h>
     #include <stdint.h>
@@ -34,53 +75,431 @@ extern "C" {
     #include <avr/wdt.h>
     #include <avr/sleep.h>
     #include <avr/interrupt.h>
+    #include <util/atomic.h>
+    #include <util/crc16.h>
 }
 
 // include the libraries for the sensors
 #include <BB_I2C.h>
 #include <BB_BME280.h>
 #include <BB_LTR303ALS01.h>
+#include <BB_ADC.h>
 #include <BB_ML8511.h>
+#include <BB_SPI.h>
+#include <BB_SAMPLELOG.h>
+#include <BB_SAMPLELOG_EEPROM.h>
+
+#if BB_SAMPLELOG_EEPROM_ADDR < BB_BME280_EEPROM_ADDR + BB_BME280_EEPROM_SIZE
+    #error "the EEPROM sample log overlaps the BME280 calibration cache"
+#endif
+
+// the frame buffers: the SPI sends one of them, the other one is filled
+volatile uint8_t frames[2][FRAME_SIZE];
+uint8_t frameNext = 0;
+
+/**
+ * Adds the CRC to a frame, copies it to the frame buffer which is not
+ * registered and registers this buffer as response. A response which has
+ * started already keeps sending the previous buffer, so the master always
+ * gets a consistent frame. If the master is still reading the buffer from
+ * the switch before, we wait until it has finished or SS goes high.
+ * @param spi the SPI
+ * @param command the command which returns the frame
+ * @param data the new frame, FRAME_SIZE bytes. The CRC is filled in.
+ */
+void storeFrame(BB_SPI &spi, uint8_t command, uint8_t *data){
+    volatile uint8_t *frame = frames[frameNext];
+    uint16_t crc = 0;
+
+    for (uint8_t i = 0; i < FRAME_CRC; i++) crc = _crc_xmodem_update(crc, data[i]);
+    data[FRAME_CRC] = (uint8_t) (crc >> 8);
+    data[FRAME_CRC + 1] = (uint8_t) crc;
+
+    // each SPI byte and SS going high wake us up
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    while (spi.isSending(frame)){
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        cli();
+    }
+    sei();
+
+    // no response can start with this buffer, it is not registered
+    for (uint8_t i = 0; i < FRAME_SIZE; i++) frame[i] = data[i];
+    spi.setResponse(command, frame, FRAME_SIZE);
+    frameNext ^= 1;
+}
+
+/**
+ * Calculates UV intensity and UV index of a UV level and stores them in the
+ * response buffer.
+ * @param uvLevel the UV level
+ * @param supply the supply voltage in mV
+ * @param data the response buffer, 4 bytes
+ */
+void storeUv(uint16_t uvLevel, uint16_t supply, volatile uint8_t *data){
+    uint16_t intensity = BB_ML8511::calculateIntensity(uvLevel, supply);
+
+    BB_SPI_storeU16(&data[0], intensity);
+    BB_SPI_storeU16(&data[2], BB_ML8511::calculateUvIndex(intensity));
+}
+
+// the tick of the scheduler in ms, only counting during measureAll()
+volatile uint16_t ticks = 0;
+
+ISR(TIMER0_COMPA_vect){
+    ticks++;
+}
+
+/**
+ * Starts the 1 ms tick (Timer0, CTC mode, 8MHz / 64 / 125).
+ */
+void tickStart(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ticks = 0;
+    }
+    TCNT0 = 0;
+    OCR0A = 124;
+    TCCR0A = (1 << WGM01);
+    TIMSK0 = (1 << OCIE0A);
+    TCCR0B = (1 << CS01) | (1 << CS00);
+}
+
+/**
+ * Stops the tick.
+ */
+void tickStop(void){
+    TCCR0B = 0;
+    TIMSK0 = 0;
+}
+
+/**
+ * Provides the tick.
+ * @return the time since tickStart() in ms
+ */
+uint16_t tickGet(void){
+    uint16_t t;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        t = ticks;
+    }
+    return t;
+}
+
+/**
+ * Measures supply voltage and MCU temperature. The controller idles while
+ * the references settle, the SPI keeps answering.
+ * @param adc the ADC
+ * @param supply the supply voltage in mV
+ * @param temperature the MCU temperature in 0.1 degC
+ * @return FRAME_STATUS_MCU if the values are valid, 0 otherwise
+ */
+uint8_t measureMcu(BB_ADC &adc, uint16_t &supply, int16_t &temperature){
+    int8_t result;
+    uint16_t now;
+
+    tickStart();
+    adc.startMcu(0);
+    do {
+        now = tickGet();
+        result = adc.measureMcu(now);
+        if (result == 0){
+            // idle until the next tick
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            cli();
+            if (tickGet() == now){
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+            sei();
+        }
+    } while (result == 0);
+    tickStop();
+    supply = adc.getSupplyVoltage();
+    temperature = adc.getTemperature();
+    return (result == 1) ? FRAME_STATUS_MCU : 0;
+}
+
+/**
+ * Measures with all sensors at the same time. This is a small cooperative
+ * scheduler: each sensor is a state machine doing one step per pass, no step
+ * waits. The ML8511 settles and the ADC converts while the BME280 converts
+ * and the I2C transfers proceed, so a sample takes as long as the slowest
+ * sensor instead of the sum of all. Supply voltage and MCU temperature use
+ * the ADC after the ML8511. When there is nothing to do, the controller
+ * idles until the next tick.
+ * @param bme the BME280
+ * @param ltr the LTR303ALS01
+ * @param ml8511 the ML8511
+ * @param adc the ADC
+ * @param bmeSample the BME280 values
+ * @param lux the LTR303ALS01 illuminance in 0.01 lx
+ * @param uvLevel the ML8511 value (average of ML8511_CONVERSIONS conversions)
+ * @param supply the supply voltage in mV
+ * @param mcuTemperature the MCU temperature in 0.1 degC
+ * @return the FRAME_STATUS_xxx bits of the sensors with valid values
+ */
+uint8_t measureAll(BB_BME280 &bme, BB_LTR303ALS01 &ltr, BB_ML8511 &ml8511, BB_ADC &adc,
+        BB_BME280_SAMPLE &bmeSample, uint32_t &lux, uint16_t &uvLevel,
+        uint16_t &supply, int16_t &mcuTemperature){
+    uint8_t status = 0x00;
+    uint8_t bmeState = TASK_START;
+    uint8_t ltrState = TASK_READ;
+    uint8_t mlState = TASK_START;
+    uint8_t mcuState = TASK_START;
+    uint16_t bmeStart = 0;
+    uint16_t bmePoll = 0;
+    uint16_t bmeTimeout = 0;
+    uint16_t ltrPoll = 0;
+    int8_t ltrResult;
+    int8_t mcuResult;
+    uint16_t uvSum = 0;
+    uint8_t uvCount = 0;
+    uint16_t now;
+
+    tickStart();
+    while ((bmeState != TASK_DONE) || (ltrState != TASK_DONE) || (mlState != TASK_DONE) || (mcuState != TASK_DONE)){
+        now = tickGet();
+
+        // ML8511: power on, wait until the output is stable, convert
+        switch (mlState){
+            case TASK_START:
+                ml8511.startSettling(now);
+                mlState = TASK_WAIT;
+            break;
+            case TASK_WAIT:
+                // not settled within the time limit: convert anyway
+                if (ml8511.settle(now) != 0){
+                    ml8511.startConversion();
+                    mlState = TASK_READ;
+                }
+            break;
+            case TASK_READ:
+                if (!ml8511.isConverting()){
+                    uvSum += ml8511.readConversion();
+                    if (++uvCount < ML8511_CONVERSIONS){
+                        ml8511.startConversion();
+                    } else {
+                        ml8511.powerOff();
+                        uvLevel = uvSum / ML8511_CONVERSIONS;
+                        status |= FRAME_STATUS_ML8511;
+                        mlState = TASK_DONE;
+                    }
+                }
+            break;
+        }
+
+        // supply voltage and MCU temperature: the ADC is free after the
+        // ML8511, the references settle between the ticks
+        switch (mcuState){
+            case TASK_START:
+                if (mlState != TASK_DONE) break;
+                adc.startMcu(now);
+                mcuState = TASK_WAIT;
+            break;
+            case TASK_WAIT:
+                mcuResult = adc.measureMcu(now);
+                if (mcuResult != 0){
+                    supply = adc.getSupplyVoltage();
+                    mcuTemperature = adc.getTemperature();
+                    if (mcuResult == 1) status |= FRAME_STATUS_MCU;
+                    mcuState = TASK_DONE;
+                }
+            break;
+        }
+
+        // BME280: trigger a conversion (forced mode), poll the measuring bit once per tick
+        switch (bmeState){
+            case TASK_START:
+                bmeStart = now;
+                bmePoll = now;
+                bmeTimeout = (uint16_t) (bme.getMaxMeasurementTime() / 1000) + 2;
+                bmeState = (bme.startMeasurement() == 1) ? TASK_WAIT : TASK_DONE;
+            break;
+            case TASK_WAIT:
+                if (now == bmePoll) break;
+                bmePoll = now;
+                if (!bme.isMeasuring()){
+                    bmeState = TASK_READ;
+                } else if ((uint16_t) (now - bmeStart) > bmeTimeout){
+                    bmeState = TASK_DONE;
+                }
+            break;
+            case TASK_READ:
+                if (bme.readAll(bmeSample) == 1) status |= FRAME_STATUS_BME280;
+                bmeState = TASK_DONE;
+            break;
+        }
+
+        // LTR303ALS01: illuminance of the last integration window, poll while
+        // the automatic ranging changes the range
+        if ((ltrState == TASK_READ) || ((ltrState == TASK_WAIT) && ((uint16_t) (now - ltrPoll) >= LTR303_POLL_MS))){
+            ltrResult = ltr.readLux(lux);
+            if ((ltrResult == 0) && (now < LTR303_RANGING_TIMEOUT_MS)){
+                ltrPoll = now;
+                ltrState = TASK_WAIT;
+            } else {
+                if (ltrResult == 1) status |= FRAME_STATUS_LTR303;
+                ltrState = TASK_DONE;
+            }
+        }
+
+        // idle until the next tick if all tasks wait for time or the ADC,
+        // the ADC interrupt ends the sleep when the conversion is complete
+        if ((mlState == TASK_WAIT) || (mlState == TASK_READ) || (mcuState == TASK_WAIT) ||
+            (bmeState == TASK_WAIT) || (ltrState == TASK_WAIT)){
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            cli();
+            if ((tickGet() == now) && ((mlState != TASK_READ) || ml8511.isConverting())){
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+            sei();
+        }
+    }
+    tickStop();
+    return status;
+}
+
+// number of watchdog interrupts (1 s) not handled yet
+volatile uint8_t wdtWakeups = 0;
+
+ISR(WDT_vect){
+    wdtWakeups++;
+}
 
 /**
- * Initiate the SPI settings. Note - the controller
- * of this board will act as SPI slave. SPI communication
- * does not use interrupts ("polling mode")
+ * Starts the watchdog in interrupt mode (no reset) with a period of 1 s.
+ * The watchdog oscillator is not calibrated, the period may be 10% off.
  */
-void SPI_SlaveInit_woInt(void){
+void wdtStart(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        wdt_reset();
+        WDTCSR = (1 << WDCE) | (1 << WDE);
+        WDTCSR = (1 << WDIE) | (1 << WDP2) | (1 << WDP1);
+        wdtWakeups = 0;
+    }
+}
 
-    volatile char dummy;
+// set by the interrupt of the LTR303ALS01, cleared by lightEventHandle()
+volatile uint8_t ltrEvent = 0;
 
-    // Set PB4(MISO) as output - all others are input
-    DDRB |= (1 << PB4);
+// The INT pin of the LTR303ALS01 is connected to PD3 (INT1). It is open drain
+// with the pull-up of PD3, so it is active low. The low level interrupt is
+// the only one waking the controller from power-down. The line stays low
+// until the data of the sensor is read, so the interrupt disables itself.
+ISR(INT1_vect){
+    EIMSK &= ~(1 << INT1);
+    ltrEvent = 1;
+}
+
+/**
+ * Enables the interrupt on the INT pin of the LTR303ALS01 (low level).
+ */
+void lightEventEnable(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        EICRA &= ~((1 << ISC11) | (1 << ISC10));
+        EIFR = (1 << INTF1);
+        EIMSK |= (1 << INT1);
+    }
+}
 
-    //Enable SPI in Slave Mode
-    SPCR  = (1 << SPE);
+/**
+ * Disables the interrupt on the INT pin of the LTR303ALS01.
+ */
+void lightEventDisable(void){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        EIMSK &= ~(1 << INT1);
+        ltrEvent = 0;
+    }
+}
+
+/**
+ * Handles an interrupt of the LTR303ALS01. Reads the light and arms the
+ * thresholds around the new value. While the range changes, the thresholds
+ * are armed so the next value triggers the interrupt at once: the thresholds
+ * are counts of the range of the sensor, the value read is from the old one.
+ * An event is counted in data[0], the light (0.01 lx) stored in data[1 .. 4].
+ * @param ltr the LTR303ALS01
+ * @param window the width of the thresholds in % of the value
+ * @param data the response buffer of the light event, 5 bytes
+ */
+void lightEventHandle(BB_LTR303ALS01 &ltr, uint8_t window, volatile uint8_t *data){
+    uint32_t lux;
+    uint16_t ch0;
+    uint16_t ch1;
+    uint16_t delta;
+    int8_t result;
+    uint8_t range;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        ltrEvent = 0;
+    }
+    // reading the data releases the INT pin, the automatic ranging may
+    // change the range
+    range = ltr.getRange();
+    result = ltr.readLux(lux);
+    if ((result == 1) && (ltr.getRange() == range) && (ltr.readChannels(ch0, ch1) >= 0)){
+        delta = (uint16_t) (((uint32_t) ch0 * window) / 100);
+        if (delta < LIGHT_EVENT_MIN_DELTA) delta = LIGHT_EVENT_MIN_DELTA;
+        ltr.setThresholds((ch0 > delta) ? ch0 - delta : 0,
+                          (ch0 < 0xFFFF - delta) ? ch0 + delta : 0xFFFF);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            data[0]++;
+        }
+        BB_SPI_storeU32(&data[1], lux);
+    } else {
+        ltr.setThresholds(0xFFFF, 0);
+    }
+    lightEventEnable();
+}
 
-    dummy   = SPSR;                         // Clear SPIF bit in SPSR
-    dummy   = SPDR;
+/**
+ * Waits for the argument of a command. Gives up when the master ends the
+ * transfer (SS high) without sending it.
+ * @param spi the SPI
+ * @return the argument or -1
+ */
+int16_t readArgument(BB_SPI &spi){
+    int16_t argument;
+
+    while ((argument = spi.read()) < 0){
+        if (PINB & (1 << PB2)) break;
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        cli();
+        if (!spi.available() && !(PINB & (1 << PB2))){
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+    return argument;
 }
 
 /**
- * Transfer data via SPI.
- * @param inData for write operations: this is the data which
- *               will be transferred from slave to master
- *               for read operations: no meaning
- * @return for read operations: the data which was transferred from
- *         master to slave
- *         for write operations: no meaning
+ * Allows the ADC noise reduction mode while the master does not select the
+ * SPI (SS high). Selecting it wakes the controller (PCINT0), the running
+ * conversion continues in the idle mode.
+ * @return 1 if SS is high
  */
-uint8_t SPI_transferData(uint8_t inData){
-    SPDR = inData;
-    //asm volatile("nop");
-    while (!(SPSR & (1 << SPIF)));
-    return SPDR;
+uint8_t spiIdle(void){
+    return (PINB & (1 << PB2)) ? 1 : 0;
 }
 
 // define an interrupt service routine which we will need to wake
 // up the processor from sleep.
 // Trigger will be a signal change at the SPI slave select pin.
 ISR(PCINT0_vect){
+    // SS is high -> the master ended the transfer, drop an unfinished response
+    if (PINB & (1 << PB2)) BB_SPI::reset();
 }
 
 int main(void){
@@ -101,16 +520,22 @@ int main(void){
 
     // initialization
 
-    SPI_SlaveInit_woInt();
+    // the SPI is handled in ISR(SPI_STC_vect), responses to the get commands
+    // are sent without involvement of the main loop
+    BB_SPI spi;
 
-    BB_I2C i2c;
+    // both sensors support the fast mode, the drivers limit the clock
+    // if a sensor does not
+    BB_I2C i2c(BB_I2C_FAST_MODE);
 
     BB_BME280 bme(&i2c);
     // check the initialization
-    if (bme.readChipId() != 0x60){
+    if (bme.readChipId() != BB_BME280_CHIPID){
         redLedOn;
         while(1);
     }
+    // lowest oversampling sufficient for environmental data, forced mode
+    bme.applyProfile(BME280_PROFILE_WEATHER_MONITORING);
     // indicates successful BME280 initialization
     greenLedOn;
     _delay_ms(2000);
@@ -134,7 +559,11 @@ int main(void){
     greenLedOff;
     _delay_ms(2000);
 
-    BB_ML8511 ml8511;
+    // the ADC is shared by the ML8511 and the internal channels
+    BB_ADC adc;
+    BB_ML8511 ml8511(&adc);
+    // the ADC noise reduction mode stops the SPI -> only while it is not selected
+    adc.setNoiseReductionCheck(spiIdle);
     // indicates successful ML8511 initialization
     // TODO - write better code(!)
     greenLedOn;
@@ -152,7 +581,7 @@ int main(void){
 
     // define variables and command codes
 
-    uint8_t newCommand = 0xFF;
+    int16_t newCommand;
 
     const uint8_t cmdSleep = 0xF0;
 
@@ -161,20 +590,98 @@ int main(void){
     const uint8_t cmdBmeGetPressure = 0x12;
     const uint8_t cmdBmeGetHumidity = 0x13;
 
-    int32_t bmeTemperature;
-    uint32_t bmePressure;
-    uint32_t bmeHumidity;
+    BB_BME280_SAMPLE bmeSample;
+    // the responses (MSB first) are read by the SPI ISR
+    static volatile uint8_t bmeTemperatureData[4];
+    static volatile uint8_t bmePressureData[4];
+    static volatile uint8_t bmeHumidityData[4];
 
     const uint8_t cmdLtrStart = 0x20;
     const uint8_t cmdLtrGetCh0 = 0x21;
     const uint8_t cmdLtrGetCh1 = 0x22;
-    uint16_t ltrCh0;
-    uint16_t ltrCh1;
+    static volatile uint8_t ltrCh0Data[2];
+    static volatile uint8_t ltrCh1Data[2];
+    const uint8_t cmdLtrGetLux = 0x23;
+    static volatile uint8_t ltrLuxData[4];
 
     const uint8_t cmdMl8511Start = 0x30;
     const uint8_t cmdMl8511GetValue = 0x31;
+    static volatile uint8_t ml8511UvLevelData[2];
+    // argument: the resolution in bit (10 .. 14), the value is read with cmdMl8511GetValue
+    const uint8_t cmdMl8511StartOversampled = 0x32;
+    // UV intensity (uint16_t, 0.01 mW/cm2) and UV index (uint16_t, 0.1) of the
+    // last cmdMl8511Start or cmdMeasureAll, corrected with the supply voltage
+    const uint8_t cmdMl8511GetUv = 0x33;
+    static volatile uint8_t ml8511UvData[4];
+
+    // supply voltage (internal bandgap against AVcc) and MCU temperature
+    const uint8_t cmdAdcStart = 0x70;
+    const uint8_t cmdAdcGetSupplyVoltage = 0x71;
+    const uint8_t cmdAdcGetTemperature = 0x72;
+    static volatile uint8_t adcSupplyData[2];       // uint16_t, mV
+    static volatile uint8_t adcTemperatureData[2];  // int16_t, 0.1 degC
+    uint16_t supply;
+    int16_t mcuTemperature;
+
+    // measure with all sensors and return all values in one frame
+    const uint8_t cmdMeasureAll = 0x40;
+    const uint8_t cmdGetFrame = 0x41;
+    uint8_t frameData[FRAME_SIZE] = {0};
+    uint16_t frameSequence = 0;
+    uint16_t ltrCh0;
+    uint16_t ltrCh1;
+    uint32_t ltrLux;
     uint16_t ml8511UvLevel;
 
+    // autonomous sampling: the watchdog wakes the controller from sleep, each
+    // period a sample is appended to the log. The master drains the log with
+    // one bulk read (number of records, then the records).
+    const uint8_t cmdLogStart = 0x50; // argument: the period in s (1 .. 255)
+    const uint8_t cmdLogStop = 0x51;
+    const uint8_t cmdLogRead = 0x52;
+    static const BB_SPI_STREAM logStream = {BB_SAMPLELOG::streamBegin, BB_SAMPLELOG::streamNext, BB_SAMPLELOG::streamEnd};
+    BB_SAMPLELOG sampleLog;
+    // the samples are also kept in the EEPROM, they survive a reset. The
+    // master reads the pages not read before with one bulk read.
+    const uint8_t cmdEepromLogRead = 0x53;
+    static const BB_SPI_STREAM eepromLogStream = {BB_SAMPLELOG_EEPROM::streamBegin, BB_SAMPLELOG_EEPROM::streamNext, BB_SAMPLELOG_EEPROM::streamEnd};
+    BB_SAMPLELOG_EEPROM eepromLog;
+    BB_SAMPLELOG_RECORD record;
+    // event driven light: the UnoEVS sleeps until the light changes by more
+    // than the window. The master polls the number of events and the light
+    // of the last one, a changed number tells it to read the other values.
+    const uint8_t cmdLightEventStart = 0x60; // argument: the window in % (1 .. 100)
+    const uint8_t cmdLightEventStop = 0x61;
+    const uint8_t cmdLightEventGet = 0x62;
+    static volatile uint8_t lightEventData[5]; // number of events (uint8_t), light (uint32_t, 0.01 lx)
+    uint8_t lightEventWindow = 0; // 0: light events are off
+    int16_t argument;
+    uint8_t logPeriod = 0; // 0: autonomous sampling is off
+    uint8_t logElapsed = 0;
+    uint8_t wakeups;
+    uint16_t elapsed;
+    uint8_t deselected;
+
+    spi.setArgumentCount(cmdMl8511StartOversampled, 1);
+    spi.setArgumentCount(cmdLogStart, 1);
+    spi.setArgumentCount(cmdLightEventStart, 1);
+    spi.setResponse(cmdLightEventGet, lightEventData, sizeof(lightEventData));
+    spi.setStream(cmdLogRead, &logStream);
+    spi.setStream(cmdEepromLogRead, &eepromLogStream);
+    // the sequence continues behind the samples in the EEPROM
+    if (eepromLog.readLast(record) != 1) record.sequence = 0;
+    spi.setResponse(cmdBmeGetTemperature, bmeTemperatureData, sizeof(bmeTemperatureData));
+    spi.setResponse(cmdBmeGetPressure, bmePressureData, sizeof(bmePressureData));
+    spi.setResponse(cmdBmeGetHumidity, bmeHumidityData, sizeof(bmeHumidityData));
+    spi.setResponse(cmdLtrGetCh0, ltrCh0Data, sizeof(ltrCh0Data));
+    spi.setResponse(cmdLtrGetCh1, ltrCh1Data, sizeof(ltrCh1Data));
+    spi.setResponse(cmdLtrGetLux, ltrLuxData, sizeof(ltrLuxData));
+    spi.setResponse(cmdMl8511GetValue, ml8511UvLevelData, sizeof(ml8511UvLevelData));
+    spi.setResponse(cmdMl8511GetUv, ml8511UvData, sizeof(ml8511UvData));
+    spi.setResponse(cmdAdcGetSupplyVoltage, adcSupplyData, sizeof(adcSupplyData));
+    spi.setResponse(cmdAdcGetTemperature, adcTemperatureData, sizeof(adcTemperatureData));
+    storeFrame(spi, cmdGetFrame, frameData);
+
     // initialize interrupt handling:
 
     // PB2 is input and is used as _SS
@@ -186,73 +693,162 @@ int main(void){
     sei(); // enable interrupts again
 
     while(1){
-        newCommand = SPI_transferData(0xFF);
-        switch(newCommand){
+        if (ltrEvent) lightEventHandle(ltr, lightEventWindow, lightEventData);
+        newCommand = spi.read();
+        if (newCommand < 0){
+            // nothing to do -> idle until the next SPI byte
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            cli();
+            if (!spi.available() && !ltrEvent){
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+            sei();
+            continue;
+        }
+        switch((uint8_t) newCommand){
             case cmdBmeStart:
-                // do the measurements
-                bmeTemperature = bme.readTemperature();
-                bmePressure = bme.readPressure();
-                bmeHumidity = bme.readHumidity();
-                cli();
+                // trigger one conversion (forced mode) and read the sample
+                bme.measure(bmeSample);
+                BB_SPI_storeU32(bmeTemperatureData, (uint32_t) bmeSample.temperature);
+                BB_SPI_storeU32(bmePressureData, bmeSample.pressure);
+                BB_SPI_storeU32(bmeHumidityData, bmeSample.humidity);
             break;
-            case cmdBmeGetTemperature:
-                // send the temperature data (4 bytes)
-                SPI_transferData((uint8_t) (bmeTemperature >> 24));
-                SPI_transferData((uint8_t) (bmeTemperature >> 16));
-                SPI_transferData((uint8_t) (bmeTemperature >> 8));
-                SPI_transferData((uint8_t) bmeTemperature);
+            case cmdLtrStart:
+                // the raw values are read again from the same integration cycle
+                if (ltr.readLux(ltrLux) == 1) BB_SPI_storeU32(ltrLuxData, ltrLux);
+                if (ltr.readChannels(ltrCh0, ltrCh1) < 0){
+                    // no valid data
+                    ltrCh0 = 0;
+                    ltrCh1 = 0;
+                }
+                BB_SPI_storeU16(ltrCh0Data, ltrCh0);
+                BB_SPI_storeU16(ltrCh1Data, ltrCh1);
             break;
-            case cmdBmeGetPressure:
-                // send the temperature data (4 bytes)
-                SPI_transferData((uint8_t) (bmePressure >> 24));
-                SPI_transferData((uint8_t) (bmePressure >> 16));
-                SPI_transferData((uint8_t) (bmePressure >> 8));
-                SPI_transferData((uint8_t) bmePressure);
+            case cmdMl8511Start:
+                // do the measurements
+                ml8511UvLevel = ml8511.readUvLevel(ML8511_CONVERSIONS);
+                BB_SPI_storeU16(ml8511UvLevelData, ml8511UvLevel);
+                storeUv(ml8511UvLevel, adc.readSupplyVoltage(), ml8511UvData);
             break;
-            case cmdBmeGetHumidity:
-                // send the temperature data (4 bytes)
-                SPI_transferData((uint8_t) (bmeHumidity >> 24));
-                SPI_transferData((uint8_t) (bmeHumidity >> 16));
-                SPI_transferData((uint8_t) (bmeHumidity >> 8));
-                SPI_transferData((uint8_t) bmeHumidity);
+            case cmdAdcStart:
+                measureMcu(adc, supply, mcuTemperature);
+                BB_SPI_storeU16(adcSupplyData, supply);
+                BB_SPI_storeU16(adcTemperatureData, (uint16_t) mcuTemperature);
             break;
-            case cmdLtrStart:
-                ltrCh0 = ltr.readChannel0();
-                ltrCh1 = ltr.readChannel1();
-                cli();
+            case cmdMl8511StartOversampled:
+                argument = readArgument(spi);
+                if (argument < 0) break;
+                // 4^(bits - 10) conversions, 27 ms at 14 bit
+                BB_SPI_storeU16(ml8511UvLevelData, ml8511.readUvLevelOversampled((uint8_t) argument));
             break;
-            case cmdLtrGetCh0:
-                // send the visible light (2 bytes)
-                SPI_transferData((uint8_t) (ltrCh0 >> 8));
-                SPI_transferData((uint8_t) ltrCh0);
+            case cmdMeasureAll:
+                // mark the old values until the new ones are available
+                frameData[FRAME_STATUS] |= FRAME_STATUS_BUSY;
+                storeFrame(spi, cmdGetFrame, frameData);
+
+                frameData[FRAME_STATUS] = measureAll(bme, ltr, ml8511, adc, bmeSample, ltrLux, ml8511UvLevel,
+                                                     supply, mcuTemperature);
+                frameSequence++;
+
+                BB_SPI_storeU32(&frameData[FRAME_TEMPERATURE], (uint32_t) bmeSample.temperature);
+                BB_SPI_storeU32(&frameData[FRAME_PRESSURE], bmeSample.pressure);
+                BB_SPI_storeU32(&frameData[FRAME_HUMIDITY], bmeSample.humidity);
+                BB_SPI_storeU32(&frameData[FRAME_LUX], ltrLux);
+                BB_SPI_storeU16(&frameData[FRAME_UV], ml8511UvLevel);
+                BB_SPI_storeU16(&frameData[FRAME_SUPPLY], supply);
+                BB_SPI_storeU16(&frameData[FRAME_MCU_TEMPERATURE], (uint16_t) mcuTemperature);
+                BB_SPI_storeU16(&frameData[FRAME_SEQUENCE], frameSequence);
+                // before the frame: UV intensity and index are valid when it is not busy
+                if (frameData[FRAME_STATUS] & FRAME_STATUS_ML8511) storeUv(ml8511UvLevel, supply, ml8511UvData);
+                storeFrame(spi, cmdGetFrame, frameData);
             break;
-            case cmdLtrGetCh1:
-                // send the visible light (2 bytes)
-                SPI_transferData((uint8_t) (ltrCh1 >> 8));
-                SPI_transferData((uint8_t) ltrCh1);
+            case cmdLogStart:
+                argument = readArgument(spi);
+                if (argument <= 0) break;
+                logPeriod = (uint8_t) argument;
+                logElapsed = 0;
+                wdtStart();
             break;
-            case cmdMl8511Start:
-                // do the measurements
-                ml8511UvLevel = ml8511.readUvLevel(3);
-                cli();
+            case cmdLogStop:
+                wdt_disable();
+                logPeriod = 0;
+                eepromLog.flush();
+            break;
+            case cmdLightEventStart:
+                argument = readArgument(spi);
+                if (argument <= 0) break;
+                lightEventWindow = (argument > 100) ? 100 : (uint8_t) argument;
+                // the first value triggers at once and arms the thresholds
+                ltr.setInterruptPersist(LIGHT_EVENT_PERSIST);
+                ltr.setThresholds(0xFFFF, 0);
+                ltr.setInterrupt(LTR303ALS01_INTERRUPT_ENABLED, LTR303ALS01_INTERRUPT_ACTIVE_LOW);
+                lightEventEnable();
             break;
-            case cmdMl8511GetValue:
-                // send the uv level (2 bytes)
-                SPI_transferData((uint8_t) (ml8511UvLevel >> 8));
-                SPI_transferData((uint8_t) ml8511UvLevel);
+            case cmdLightEventStop:
+                lightEventDisable();
+                ltr.setInterrupt(LTR303ALS01_INTERRUPT_DISABLED, LTR303ALS01_INTERRUPT_ACTIVE_LOW);
+                lightEventWindow = 0;
             break;
             case cmdSleep:
-                set_sleep_mode(SLEEP_MODE_PWR_DOWN);
                 power_adc_disable();
-                sleep_enable();
-                sei();
-                sleep_cpu();
-                sleep_disable();
-                if (PINB & (1 << PB2) ){
-                    // SS is high -> this was the wrong signal -> sleep again
-                    sleep_enable();
-                    sleep_cpu();
-                    sleep_disable();
+                // the samples are only taken while sleeping, the time awake
+                // does not count for the period
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                    wdtWakeups = 0;
+                }
+                // sleep until the master selects the UnoEVS again: SS has to
+                // go high (end of this transfer) and low again
+                deselected = 0;
+                while(1){
+                    cli();
+                    // the EEPROM ready interrupt of a page write does not wake
+                    // the controller from power-down
+                    set_sleep_mode(eepromLog.isWriting() ? SLEEP_MODE_IDLE : SLEEP_MODE_PWR_DOWN);
+                    if (PINB & (1 << PB2)){
+                        deselected = 1;
+                    } else if (deselected){
+                        sei();
+                        break;
+                    }
+                    if (!wdtWakeups && !ltrEvent){
+                        sleep_enable();
+                        sei();
+                        sleep_cpu();
+                        sleep_disable();
+                    }
+                    sei();
+
+                    if (ltrEvent) lightEventHandle(ltr, lightEventWindow, lightEventData);
+                    if (wdtWakeups){
+                        // all seconds count, also those passed while measuring
+                        // or handling a light event -> the period does not drift
+                        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                            wakeups = wdtWakeups;
+                            wdtWakeups = 0;
+                        }
+                        elapsed = (uint16_t) logElapsed + wakeups;
+                        if ((logPeriod > 0) && (elapsed >= logPeriod)){
+                            // one sample, the rest of the seconds counts for the next one
+                            logElapsed = (uint8_t) (elapsed % logPeriod);
+                            power_adc_enable();
+                            record.status = measureAll(bme, ltr, ml8511, adc, bmeSample, ltrLux, ml8511UvLevel,
+                                                       record.supply, record.mcuTemperature);
+                            power_adc_disable();
+                            record.sequence++;
+                            record.temperature = (int16_t) bmeSample.temperature;
+                            record.pressure = bmeSample.pressure;
+                            record.humidity = (uint16_t) ((bmeSample.humidity * 100 + 512) >> 10);
+                            record.lux = ltrLux;
+                            record.uvLevel = ml8511UvLevel;
+                            sampleLog.append(record);
+                            eepromLog.append(record);
+                        } else {
+                            logElapsed = (uint8_t) elapsed;
+                        }
+                    }
                 }
                 power_adc_enable();
             break;
@@ -0,0 +1,184 @@
+/*
+ * BB_ADC.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include "BB_ADC.h"
+
+// set by the ADC interrupt when a conversion is complete
+static volatile uint8_t _adcDone = 0;
+
+ISR(ADC_vect){
+	_adcDone = 1;
+}
+
+// public:
+
+BB_ADC::BB_ADC(){
+	this->_bandgap = BB_ADC_BANDGAP_MV;
+	this->_temperatureOffset = 0;
+	this->_sleepMode = SLEEP_MODE_ADC;
+	this->_noiseReductionAllowed = 0;
+	this->_mcuPhase = BB_ADC_MCU_DONE;
+	this->_supply = 0;
+	this->_temperature = 0;
+	ADMUX = (1<<REFS0); // Select Vref=AVcc
+	// 8MHz / 64 = 125 kHz ADC clock, enable ADC
+	ADCSRA = BB_ADC_PRESCALER_64 | (1<<ADEN);
+}
+
+uint16_t BB_ADC::read(uint8_t channel){
+	uint8_t started = 0;
+	uint8_t mode;
+
+	//select ADC channel with safety mask
+	ADMUX = (ADMUX & 0xF0) | (channel & 0x0F);
+	_adcDone = 0;
+	ADCSRA |= (1<<ADIE);
+	// Other interrupts (e.g. pin change, SPI) may wake the controller before
+	// the conversion is complete -> sleep again, the conversion continues.
+	// The mode is chosen again after each wake up.
+	do {
+		mode = this->_sleepMode;
+		if ((mode == SLEEP_MODE_ADC) && this->_noiseReductionAllowed &&
+		    !this->_noiseReductionAllowed()) mode = SLEEP_MODE_IDLE;
+		set_sleep_mode(mode);
+		cli();
+		if (!_adcDone){
+			// entering the ADC noise reduction mode starts the conversion, in
+			// the idle mode it is started here
+			if ((mode != SLEEP_MODE_ADC) && !started) ADCSRA |= (1<<ADSC);
+			started = 1;
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
+	} while (!_adcDone);
+	ADCSRA &= ~(1<<ADIE);
+	return ADC;
+}
+
+void BB_ADC::setSleepMode(uint8_t mode){
+	this->_sleepMode = mode;
+}
+
+void BB_ADC::setNoiseReductionCheck(uint8_t (*allowed)(void)){
+	this->_noiseReductionAllowed = allowed;
+}
+
+void BB_ADC::startConversion(uint8_t channel){
+	//select ADC channel with safety mask
+	ADMUX = (ADMUX & 0xF0) | (channel & 0x0F);
+	//single conversion mode, the interrupt ends an idle sleep
+	_adcDone = 0;
+	ADCSRA |= (1<<ADSC)|(1<<ADIE);
+}
+
+uint8_t BB_ADC::isConverting(void){
+	return (ADCSRA & (1<<ADSC)) ? 1 : 0;
+}
+
+uint16_t BB_ADC::readConversion(void){
+	return ADC;
+}
+
+void BB_ADC::setPrescaler(uint8_t prescaler){
+	ADCSRA = (ADCSRA & ~0x07) | (prescaler & 0x07);
+}
+
+uint32_t BB_ADC::getConversionTime(uint16_t count){
+	// 13 ADC clocks per conversion, the ADC clock is F_CPU / 2^ADPS
+	return (((uint32_t) BB_ADC_CLOCKS * count) << (ADCSRA & 0x07)) / (F_CPU / 1000000UL);
+}
+
+uint16_t BB_ADC::readSupplyVoltage(void){
+	ADMUX = (ADMUX & 0xF0) | BB_ADC_CHANNEL_BANDGAP;
+	_delay_ms(BB_ADC_BANDGAP_SETTLE_MS);
+	return this->_calculateSupply(this->_readInternal(BB_ADC_CHANNEL_BANDGAP));
+}
+
+void BB_ADC::setBandgapVoltage(uint16_t bandgap){
+	this->_bandgap = bandgap;
+}
+
+void BB_ADC::startMcu(uint16_t now){
+	// bandgap against AVcc
+	ADMUX = (1<<REFS0) | BB_ADC_CHANNEL_BANDGAP;
+	this->_mcuPhase = BB_ADC_MCU_SUPPLY;
+	this->_mcuStart = now;
+	this->_supply = 0;
+}
+
+int8_t BB_ADC::measureMcu(uint16_t now){
+	uint16_t elapsed = now - this->_mcuStart;
+	uint16_t sum;
+
+	// the settle times are at least the given ms, the start of a phase may
+	// be anywhere within a ms
+	switch (this->_mcuPhase){
+		case BB_ADC_MCU_SUPPLY:
+			if (elapsed <= BB_ADC_BANDGAP_SETTLE_MS) return 0;
+			this->_supply = this->_calculateSupply(this->_readInternal(BB_ADC_CHANNEL_BANDGAP));
+			// the temperature sensor is measured against the internal reference
+			ADMUX = (1<<REFS1) | (1<<REFS0) | BB_ADC_CHANNEL_TEMPERATURE;
+			this->_mcuPhase = BB_ADC_MCU_TEMPERATURE;
+			this->_mcuStart = now;
+			return 0;
+		case BB_ADC_MCU_TEMPERATURE:
+			if (elapsed <= BB_ADC_REFERENCE_SETTLE_MS) return 0;
+			sum = this->_readInternal(BB_ADC_CHANNEL_TEMPERATURE);
+			// T = (level - 324.31) / 1.22 degC = (level * 1000 - 324310) / 122 in 0.1 degC
+			this->_temperature = (int16_t) (((int32_t) sum * (1000 / BB_ADC_INTERNAL_CONVERSIONS)
+			                                 - BB_ADC_TEMPERATURE_OFFSET) / BB_ADC_TEMPERATURE_SLOPE)
+			                     + this->_temperatureOffset;
+			// back to AVcc, the external channels are converted without waiting
+			ADMUX = (1<<REFS0) | BB_ADC_CHANNEL_BANDGAP;
+			this->_mcuPhase = BB_ADC_MCU_RESTORE;
+			this->_mcuStart = now;
+			return 0;
+		case BB_ADC_MCU_RESTORE:
+			if (elapsed <= BB_ADC_REFERENCE_SETTLE_MS) return 0;
+			// the first conversion after switching the reference is not valid
+			this->read(BB_ADC_CHANNEL_BANDGAP);
+			this->_mcuPhase = BB_ADC_MCU_DONE;
+		break;
+	}
+	return (this->_supply > 0) ? 1 : -1;
+}
+
+uint16_t BB_ADC::getSupplyVoltage(void){
+	return this->_supply;
+}
+
+int16_t BB_ADC::getTemperature(void){
+	return this->_temperature;
+}
+
+void BB_ADC::setTemperatureOffset(int16_t offset){
+	this->_temperatureOffset = offset;
+}
+
+// private:
+
+uint16_t BB_ADC::_readInternal(uint8_t channel){
+	uint16_t sum = 0;
+
+	// the internal sources have a high output impedance, the sample and hold
+	// capacitor needs time to charge after switching the channel -> discard
+	// the first conversion
+	this->read(channel);
+	for (uint8_t i = 0; i < BB_ADC_INTERNAL_CONVERSIONS; i++){
+		sum += this->read(channel);
+	}
+	return sum;
+}
+
+uint16_t BB_ADC::_calculateSupply(uint16_t sum){
+	if (sum == 0) return 0;
+	// level = bandgap * 1024 / supply
+	return (uint16_t) (((uint32_t) this->_bandgap * 1024 * BB_ADC_INTERNAL_CONVERSIONS + sum / 2) / sum);
+}
@@ -0,0 +1,236 @@
+/**
+ * BB_ADC.h - Library providing the ADC of the Atmega328P to the sensor
+ * libraries. Besides the external channels it measures the supply voltage
+ * (internal bandgap against AVcc) and the internal temperature sensor.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+extern "C" {
+	#include <avr/io.h>
+	#include <avr/interrupt.h>
+	#include <avr/sleep.h>
+    #include <stdint.h>
+	#include <util/delay.h>
+}
+
+#ifndef BB_ADC_H_
+#define BB_ADC_H_
+
+#ifndef F_CPU
+    #define F_CPU 8000000UL
+#endif
+
+// ADC prescaler (ADPS2:0), the ADC clock has to be 50 .. 200 kHz for 10 bit
+// accuracy. A conversion takes 13 ADC clocks, at 8 MHz:
+#define BB_ADC_PRESCALER_16  4  // 500 kHz,  26 us (reduced accuracy)
+#define BB_ADC_PRESCALER_32  5  // 250 kHz,  52 us (reduced accuracy)
+#define BB_ADC_PRESCALER_64  6  // 125 kHz, 104 us
+#define BB_ADC_PRESCALER_128 7  //  62.5 kHz, 208 us
+#define BB_ADC_CLOCKS 13
+
+// internal channels (MUX3:0)
+#define BB_ADC_CHANNEL_TEMPERATURE 8
+#define BB_ADC_CHANNEL_BANDGAP 14
+
+// the internal bandgap reference measured against AVcc gives the supply
+// voltage. The typical value may be replaced by the value measured on a board.
+#define BB_ADC_BANDGAP_MV 1100
+#define BB_ADC_BANDGAP_SETTLE_MS 1
+
+// the temperature sensor is measured against the internal 1.1V reference.
+// The capacitor at AREF has to follow each change of the reference.
+#define BB_ADC_REFERENCE_SETTLE_MS 20
+
+// typical characteristic of the temperature sensor: level = 324.31 + 1.22 * T
+#define BB_ADC_TEMPERATURE_OFFSET 324310  // level * 1000 at 0 degC
+#define BB_ADC_TEMPERATURE_SLOPE 122      // level * 100 per degC
+
+// number of conversions averaged for the internal channels
+#define BB_ADC_INTERNAL_CONVERSIONS 4
+
+// phases of the measurement of supply voltage and MCU temperature
+#define BB_ADC_MCU_SUPPLY 0       // the bandgap settles
+#define BB_ADC_MCU_TEMPERATURE 1  // the internal reference settles
+#define BB_ADC_MCU_RESTORE 2      // AVcc settles
+#define BB_ADC_MCU_DONE 3
+
+/**
+ * Objects of this class represent the ADC of the Atmega328P. The external
+ * channels are converted with AVcc as reference.
+ */
+class BB_ADC{
+	public:
+	    /**
+	     * Initializes the ADC: AVcc reference, prescaler 64, conversions in
+	     * the ADC noise reduction sleep mode.
+	     */
+	    BB_ADC();
+
+		/**
+		 * Converts one channel. The controller sleeps in the mode set by
+		 * setSleepMode() and is woken by the ADC interrupt.
+		 * @param channel the ADC channel
+		 * @return the ADC value
+		 */
+		uint16_t read(uint8_t channel);
+
+		/**
+		 * Sets the sleep mode of read(). SLEEP_MODE_ADC (default) halts the
+		 * CPU and the I/O clocks during the conversion, the SPI cannot receive
+		 * then. SLEEP_MODE_IDLE keeps SPI and timers running.
+		 * @param mode SLEEP_MODE_ADC or SLEEP_MODE_IDLE
+		 */
+		void setSleepMode(uint8_t mode);
+
+		/**
+		 * Sets a check which allows the ADC noise reduction mode. In
+		 * SLEEP_MODE_ADC read() calls it before each sleep and sleeps in the
+		 * idle mode if it returns 0, e.g. while the SPI is selected. An
+		 * interrupt (pin change) waking the controller makes read() call the
+		 * check again, the conversion continues in the idle mode then.
+		 * @param allowed returns 1 if the ADC noise reduction mode can be used, 0 for always
+		 */
+		void setNoiseReductionCheck(uint8_t (*allowed)(void));
+
+		/**
+		 * Starts one conversion. The ADC interrupt wakes the controller from
+		 * idle sleep when the conversion is complete.
+		 * @param channel the ADC channel
+		 */
+		void startConversion(uint8_t channel);
+
+		/**
+		 * Checks if the ADC conversion is running.
+		 * @return 1 if the ADC is converting, 0 otherwise
+		 */
+		uint8_t isConverting(void);
+
+		/**
+		 * Provides the result of the last conversion.
+		 * @return the ADC value
+		 */
+		uint16_t readConversion(void);
+
+		/**
+		 * Sets the prescaler of the ADC clock.
+		 * @param prescaler BB_ADC_PRESCALER_X
+		 */
+		void setPrescaler(uint8_t prescaler);
+
+		/**
+		 * Calculates the time of a number of conversions at the current prescaler.
+		 * @param count the number of conversions
+		 * @return the conversion time in us
+		 */
+		uint32_t getConversionTime(uint16_t count);
+
+		/**
+		 * Measures the supply voltage (AVcc) with the internal bandgap reference.
+		 * Waits BB_ADC_BANDGAP_SETTLE_MS.
+		 * @return the supply voltage in mV, 0 if the measurement failed
+		 */
+		uint16_t readSupplyVoltage(void);
+
+		/**
+		 * Sets the voltage of the internal bandgap reference (calibration).
+		 * @param bandgap the voltage in mV, BB_ADC_BANDGAP_MV by default
+		 */
+		void setBandgapVoltage(uint16_t bandgap);
+
+		/**
+		 * Starts the measurement of supply voltage and MCU temperature. The
+		 * temperature sensor is measured against the internal reference, so
+		 * the reference is switched twice. measureMcu() has to be called
+		 * until the measurement is complete, the ADC is not free before.
+		 * @param now the current time in ms
+		 */
+		void startMcu(uint16_t now);
+
+		/**
+		 * Continues the measurement of supply voltage and MCU temperature
+		 * without waiting: it returns while the inputs settle (about
+		 * 2 * BB_ADC_REFERENCE_SETTLE_MS in total) and converts once they
+		 * have settled.
+		 * @param now the current time in ms
+		 * @return 0 while measuring, 1 if the values are valid, -1 if the
+		 * supply voltage could not be measured
+		 */
+		int8_t measureMcu(uint16_t now);
+
+		/**
+		 * Provides the supply voltage of the last measureMcu().
+		 * @return the supply voltage in mV, 0 if the measurement failed
+		 */
+		uint16_t getSupplyVoltage(void);
+
+		/**
+		 * Provides the MCU temperature of the last measureMcu(). The typical
+		 * characteristic is off by up to 10 degC, setTemperatureOffset()
+		 * corrects a board.
+		 * @return the temperature in 0.1 degC
+		 */
+		int16_t getTemperature(void);
+
+		/**
+		 * Sets the correction of the internal temperature sensor.
+		 * @param offset added to the temperature, 0.1 degC
+		 */
+		void setTemperatureOffset(int16_t offset);
+
+	private:
+		/**
+		 * The voltage of the bandgap reference in mV.
+		 */
+		uint16_t _bandgap;
+
+		/**
+		 * The correction of the temperature in 0.1 degC.
+		 */
+		int16_t _temperatureOffset;
+
+		/**
+		 * The sleep mode of read().
+		 */
+		uint8_t _sleepMode;
+
+		/**
+		 * Allows the ADC noise reduction mode, 0 if it is always allowed.
+		 */
+		uint8_t (*_noiseReductionAllowed)(void);
+
+		/**
+		 * The phase of measureMcu(), BB_ADC_MCU_X.
+		 */
+		uint8_t _mcuPhase;
+
+		/**
+		 * The start of the phase in ms.
+		 */
+		uint16_t _mcuStart;
+
+		/**
+		 * The results of measureMcu().
+		 */
+		uint16_t _supply;
+		int16_t _temperature;
+
+		/**
+		 * Converts an internal channel which has settled: discards one
+		 * conversion and sums BB_ADC_INTERNAL_CONVERSIONS.
+		 * @param channel the ADC channel
+		 * @return the sum of the conversions
+		 */
+		uint16_t _readInternal(uint8_t channel);
+
+		/**
+		 * Calculates the supply voltage.
+		 * @param sum the sum of the bandgap conversions
+		 * @return the supply voltage in mV, 0 if the sum is 0
+		 */
+		uint16_t _calculateSupply(uint16_t sum);
+};
+
+#endif /* BB_ADC_H_ */
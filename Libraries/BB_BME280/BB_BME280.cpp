@@ -7,28 +7,106 @@
 
 #include "BB_BME280.h"
 
+// layout of the EEPROM cache of the calibration values
+struct BB_BME280_CALIBRATION_CACHE{
+	uint8_t chipId;
+	BB_BME280_CALIBRATION calibration;
+	uint8_t crc;
+};
+
+static_assert(sizeof(BB_BME280_CALIBRATION_CACHE) <= BB_BME280_EEPROM_SIZE,
+              "the calibration cache does not fit into BB_BME280_EEPROM_SIZE");
+static_assert((BB_BME280_CALIBRATION_TP_SIZE == CALIB_DIG_H1 - CALIB_DIG_T1_LSB + 1) &&
+              (BB_BME280_CALIBRATION_H_SIZE == CALIB_DIG_H6 - CALIB_DIG_H2_LSB + 1),
+              "the calibration blocks do not match the registers");
+
+// settings of the BME280_PROFILE_X (datasheet, chapter 3.5)
+static const BB_BME280_SETTINGS _profiles[] = {
+	// weather monitoring
+	{BME280_StandbyTime_1000ms, BME280_Filter_off, BME280_SPI3w_disable,
+	 BME280_osrs_t_x1, BME280_osrs_p_x1, BME280_MODE_FORCED, BME280_osrs_h_x1},
+	// humidity sensing
+	{BME280_StandbyTime_1000ms, BME280_Filter_off, BME280_SPI3w_disable,
+	 BME280_osrs_t_x1, BME280_osrs_p_SKIPPED, BME280_MODE_FORCED, BME280_osrs_h_x1},
+	// indoor navigation
+	{BME280_StandbyTime_500us, BME280_Filter_16, BME280_SPI3w_disable,
+	 BME280_osrs_t_x2, BME280_osrs_p_x16, BME280_MODE_NORMAL, BME280_osrs_h_x1},
+	// gaming
+	{BME280_StandbyTime_500us, BME280_Filter_16, BME280_SPI3w_disable,
+	 BME280_osrs_t_x1, BME280_osrs_p_x4, BME280_MODE_NORMAL, BME280_osrs_h_SKIPPED}
+};
+
 // public:
 
 BB_BME280::BB_BME280(BB_I2C *i2c){
 	this->_i2c = i2c;
 	this->_i2cAddr = BB_BME280_ADDRESS;
+	this->_i2c->setDeviceClock(this->_i2cAddr, BB_BME280_MAX_SCL_CLOCK);
 
     this->_settings = {
 	    BME280_StandbyTime_500ms,
-	    BME280_Filter_16,
+	    BME280_Filter_off,
 	    BME280_SPI3w_disable,
-	    BME280_osrs_t_x16,
+	    BME280_osrs_t_x1,
 	    BME280_osrs_p_x16,
-	    BME280_MODE_NORMAL,          // normal mode
-	    BME280_osrs_h_x16
+	    BME280_MODE_FORCED,          // measure on demand
+	    BME280_osrs_h_x4
     };
 
     this->_t_fine = 0;
 
-    this->_readCalibration();
+    // the calibration is read from the sensor only if the EEPROM cache is
+    // invalid or belongs to another sensor, a failed read is not cached
+    uint8_t chipId = this->readChipId();
+    if ((this->_loadCalibration(chipId) != 1) || (this->_checkCalibration() != 1)){
+        if ((this->_readCalibration() == 1) && (chipId == BB_BME280_CHIPID)) this->_storeCalibration(chipId);
+    }
+    BB_BME280_deriveCoefficients(this->_calibration, this->_coefficients);
+
+    // the sensor sleeps until a measurement is triggered
+    this->applySettings(this->_settings);
+}
+
+int8_t BB_BME280::applySettings(const BB_BME280_SETTINGS &settings){
+	int8_t r_val = 1;
+
+	// config is only written reliably in sleep mode (DS 5.4.6)
+	if (this->_i2cWrite((BB_BME280_REGISTER) CONTROL, this->_ctrlMeas(BME280_MODE_SLEEP)) != 1) r_val = -1;
+
+	this->_settings = settings;
+
+	if (this->_i2cWrite((BB_BME280_REGISTER) CONFIG,
+	                    (uint8_t) (((settings.StandbyTime & 0x07) << 5) |
+	                               ((settings.Filter & 0x07) << 2) |
+	                               (settings.SPI3w_en & 0x01))) != 1) r_val = -1;
+	// ctrl_hum becomes effective with the next write of ctrl_meas (DS 5.4.3)
+	if (this->_i2cWrite((BB_BME280_REGISTER) CONTROLHUMID, settings.osrs_h & 0x07) != 1) r_val = -1;
+	// forced mode: stay in sleep mode until a measurement is triggered
+	if (this->_i2cWrite((BB_BME280_REGISTER) CONTROL,
+	                    this->_ctrlMeas((settings.MODE == BME280_MODE_NORMAL) ? BME280_MODE_NORMAL
+	                                                                          : BME280_MODE_SLEEP)) != 1) r_val = -1;
+	return r_val;
+}
+
+int8_t BB_BME280::applyProfile(uint8_t profile){
+	if (profile >= sizeof(_profiles) / sizeof(_profiles[0])) return -1;
+	return this->applySettings(_profiles[profile]);
+}
+
+int8_t BB_BME280::readSettings(BB_BME280_SETTINGS &settings){
+	// ctrl_hum, status, ctrl_meas, config = 0xF2 .. 0xF5
+	uint8_t data[CONFIG + 1 - CONTROLHUMID];
 
-    this->_i2cWrite((BB_BME280_REGISTER) CONTROLHUMID, (uint8_t) 0x03); // Set before CONTROL (DS 5.4.3)
-    this->_i2cWrite((BB_BME280_REGISTER) CONTROL, (uint8_t) 0x3F);
+	if (this->_i2cReadBlock((BB_BME280_REGISTER) CONTROLHUMID, data, sizeof(data)) != 1) return -1;
+
+	settings.osrs_h = data[0] & 0x07;
+	settings.osrs_t = (data[CONTROL - CONTROLHUMID] >> 5) & 0x07;
+	settings.osrs_p = (data[CONTROL - CONTROLHUMID] >> 2) & 0x07;
+	settings.MODE = data[CONTROL - CONTROLHUMID] & 0x03;
+	settings.StandbyTime = (data[CONFIG - CONTROLHUMID] >> 5) & 0x07;
+	settings.Filter = (data[CONFIG - CONTROLHUMID] >> 2) & 0x07;
+	settings.SPI3w_en = data[CONFIG - CONTROLHUMID] & 0x01;
+	return 1;
 }
 
 uint8_t BB_BME280::readChipId(void){
@@ -36,141 +114,104 @@ uint8_t BB_BME280::readChipId(void){
 }
 
 int32_t BB_BME280::readTemperature(void){
-    int32_t adc_T = (int32_t) ((((uint32_t) this->_i2cRead((BB_BME280_REGISTER) TEMPERATUREDATA)) << 12) |
-                               (((uint32_t) this->_i2cRead((BB_BME280_REGISTER) (TEMPERATUREDATA + 1))) << 4) |
-                               (((uint32_t) this->_i2cRead((BB_BME280_REGISTER) (TEMPERATUREDATA + 2))) >> 4)
+    uint8_t data[3];  // TEMP_MSB = 0xFA, TEMP_LSB = 0xFB, TEMP_XLSB = 0xFC
+    this->_i2cReadBlock((BB_BME280_REGISTER) TEMPERATUREDATA, data, sizeof(data));
+    int32_t adc_T = (int32_t) ((((uint32_t) data[0]) << 12) |
+                               (((uint32_t) data[1]) << 4) |
+                               (((uint32_t) data[2]) >> 4)
                               );
-	int32_t x1_t = ((((adc_T >> 3) - ((int32_t) this->_calibration.dig_T1 << 1)))
-					* ((int32_t) this->_calibration.dig_T2)) >> 11;
-
-	int32_t x2_t = (((((adc_T >> 4) - (this->_calibration.dig_T1)) * ((adc_T >> 4) - this->_calibration.dig_T1)) >> 12) * this->_calibration.dig_T3) >> 14;
-
-	this->_t_fine = x1_t + x2_t;
-
-	int32_t temperature = (this->_t_fine * 5 + 128) >> 8;
-	return temperature;
+    return BB_BME280_compensateTemperature(this->_calibration, this->_coefficients, adc_T, this->_t_fine);
 }
 
 uint32_t BB_BME280::readPressure(void){
-	int32_t adc_P = (int32_t)((((uint32_t) this->_i2cRead((BB_BME280_REGISTER) PRESSUREDATA)) << 12) |       // PRESS_MSB = 0xF7
-			                  (((uint32_t) this->_i2cRead((BB_BME280_REGISTER) (PRESSUREDATA + 1))) << 4) |  // PRESS_LSB = 0xF8
-			                  (((uint32_t) this->_i2cRead((BB_BME280_REGISTER) (PRESSUREDATA + 2))) >> 4)    // PRESS_XLSB = 0xF9
+	uint8_t data[3];
+	this->_i2cReadBlock((BB_BME280_REGISTER) PRESSUREDATA, data, sizeof(data));
+	int32_t adc_P = (int32_t)((((uint32_t) data[0]) << 12) |       // PRESS_MSB = 0xF7
+			                  (((uint32_t) data[1]) << 4) |        // PRESS_LSB = 0xF8
+			                  (((uint32_t) data[2]) >> 4)          // PRESS_XLSB = 0xF9
 							 );
-
-	int32_t x1_p = (((int32_t) this->_t_fine) >> 1) - (int32_t)64000;
-
-	int32_t x2_p = (((x1_p >> 2) * (x1_p >> 2)) >> 11) * ((int32_t) this->_calibration.dig_P6);
-	x2_p = x2_p + ((x1_p * ((int32_t) this->_calibration.dig_P5)) << 1);
-	x2_p = (x2_p >> 2) + (((int32_t) this->_calibration.dig_P4) << 16);
-
-	x1_p = (((this->_calibration.dig_P3 * (((x1_p >> 2) * (x1_p >> 2)) >> 13)) >> 3) +
-	        ((((int32_t) this->_calibration.dig_P2) * x1_p) >> 1)) >> 18;
-
-	x1_p = ((((32768 + x1_p)) * ((int32_t) this->_calibration.dig_P1)) >> 15);
-
-	uint32_t pressure = (((uint32_t)(((int32_t)1048576) - adc_P) - (x2_p >> 12))) * 3125;
-	if (pressure < 0x80000000){
-		/* Avoid exception caused by division by zero */
-		if (x1_p != 0){
-			pressure = (pressure << 1) / ((uint32_t) x1_p);
-		} else {
-			return 0;
-		}
-	} else {
-		if (x1_p != 0){
-			pressure = (pressure << 1 / (uint32_t) x1_p) * 2;
-		} else {
-			return 0;
-		}
-	}
-
-	x1_p = (((int32_t) this->_calibration.dig_P9) *
-		    ((int32_t)(((pressure >> 3) * ( pressure >> 3)) >> 13))) >> 12;
-	x2_p = (((int32_t)(pressure >> 2)) * ((int32_t) this->_calibration.dig_P8)) >> 13;
-    pressure = (uint32_t)((int32_t)pressure + ((x1_p + x2_p + this->_calibration.dig_P7) >> 4));
-
-	return pressure;
+	return BB_BME280_compensatePressure(this->_calibration, this->_coefficients, adc_P, this->_t_fine);
 }
 
 uint32_t BB_BME280::readHumidity(void) {
-
-  int32_t adc_H = (int32_t) ((((uint32_t) this->_i2cRead((BB_BME280_REGISTER) HUMIDITYDATA)) << 8) |  // HUM_MSB = 0xFD
-                             ((uint32_t) this->_i2cRead((BB_BME280_REGISTER) (HUMIDITYDATA + 1)))           // HUM_LSB = 0xFE
+  uint8_t data[2];
+  this->_i2cReadBlock((BB_BME280_REGISTER) HUMIDITYDATA, data, sizeof(data));
+  int32_t adc_H = (int32_t) ((((uint32_t) data[0]) << 8) |  // HUM_MSB = 0xFD
+                             ((uint32_t) data[1])           // HUM_LSB = 0xFE
 							 );
+  return BB_BME280_compensateHumidity(this->_calibration, this->_coefficients, adc_H, this->_t_fine);
+}
 
-  int32_t v_x1_u32r;
-
-  v_x1_u32r = (this->_t_fine - ((int32_t)76800));
+int8_t BB_BME280::readAll(BB_BME280_SAMPLE &sample){
+	// PRESS_MSB .. HUM_LSB = 0xF7 .. 0xFE
+	uint8_t data[HUMIDITYDATA + 2 - PRESSUREDATA];
+	BB_I2C_TRANSACTION transaction;
+
+	// burst read by the interrupt driven engine, the controller sleeps meanwhile
+	if (this->_i2c->readBlockAsync((BB_BME280_REGISTER) PRESSUREDATA, this->_i2cAddr,
+	                               data, sizeof(data), &transaction) != 1) return -1;
+	if (this->_i2c->wait(&transaction) != 1) return -1;
+
+	int32_t adc_P = (int32_t) ((((uint32_t) data[0]) << 12) | (((uint32_t) data[1]) << 4) | (((uint32_t) data[2]) >> 4));
+	int32_t adc_T = (int32_t) ((((uint32_t) data[3]) << 12) | (((uint32_t) data[4]) << 4) | (((uint32_t) data[5]) >> 4));
+	int32_t adc_H = (int32_t) ((((uint32_t) data[6]) << 8) | ((uint32_t) data[7]));
+
+	// temperature first: calculates _t_fine for pressure and humidity
+	sample.temperature = BB_BME280_compensateTemperature(this->_calibration, this->_coefficients, adc_T, this->_t_fine);
+	sample.pressure = BB_BME280_compensatePressure(this->_calibration, this->_coefficients, adc_P, this->_t_fine);
+	sample.humidity = BB_BME280_compensateHumidity(this->_calibration, this->_coefficients, adc_H, this->_t_fine);
+	return 1;
+}
 
-  v_x1_u32r = (((((adc_H << 14) - (((int32_t) this->_calibration.dig_H4) << 20) -
-		  (((int32_t) this->_calibration.dig_H5) * v_x1_u32r)) + ((int32_t)16384)) >> 15) *
-	       (((((((v_x1_u32r * ((int32_t) this->_calibration.dig_H6)) >> 10) *
-		    (((v_x1_u32r * ((int32_t) this->_calibration.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
-		  ((int32_t)2097152)) * ((int32_t) this->_calibration.dig_H2) + 8192) >> 14));
+int8_t BB_BME280::startMeasurement(void){
+	if (this->_settings.MODE == BME280_MODE_NORMAL) return 1;
+	return this->_i2cWrite((BB_BME280_REGISTER) CONTROL, this->_ctrlMeas(BME280_MODE_FORCED));
+}
 
-  v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
-			     ((int32_t) this->_calibration.dig_H1)) >> 4));
+uint8_t BB_BME280::isMeasuring(void){
+	BB_BME280_STATUS status;
+	if (this->readStatus(status) != 1) return 0;
+	return status.measuring;
+}
 
-  v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
-  v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
+int8_t BB_BME280::measure(BB_BME280_SAMPLE &sample){
+	uint32_t maxTime = this->getMaxMeasurementTime();
+	uint32_t elapsed = 0;
 
-  return (uint32_t) (v_x1_u32r>>12);
-}
+	if (this->startMeasurement() != 1) return -1;
 
+	// poll the measuring bit every ms, the sensor needs at least 1 ms
+	do {
+		if (elapsed > maxTime) return -1;
+		_delay_ms(1);
+		elapsed += 1000;
+	} while (this->isMeasuring());
 
-uint16_t BB_BME280::getCalibT1(void){
-	return this->_calibration.dig_T1;
-}
-int16_t BB_BME280::getCalibT2(void){
-	return this->_calibration.dig_T2;
-}
-int16_t BB_BME280::getCalibT3(void){
-	return this->_calibration.dig_T3;
-}
-uint16_t BB_BME280::getCalibP1(void){
-	return this->_calibration.dig_P1;
-}
-int16_t BB_BME280::getCalibP2(void){
-	return this->_calibration.dig_P2;
-}
-int16_t BB_BME280::getCalibP3(void){
-	return this->_calibration.dig_P3;
-}
-int16_t BB_BME280::getCalibP4(void){
-	return this->_calibration.dig_P4;
-}
-int16_t BB_BME280::getCalibP5(void){
-	return this->_calibration.dig_P5;
-}
-int16_t BB_BME280::getCalibP6(void){
-	return this->_calibration.dig_P6;
+	return this->readAll(sample);
 }
-int16_t BB_BME280::getCalibP7(void){
-	return this->_calibration.dig_P7;
-}
-int16_t BB_BME280::getCalibP8(void){
-	return this->_calibration.dig_P8;
-}
-int16_t BB_BME280::getCalibP9(void){
-	return this->_calibration.dig_P9;
-}
-uint16_t BB_BME280::getCalibH1(void){
-	return (uint16_t) this->_calibration.dig_H1;
-}
-int16_t BB_BME280::getCalibH2(void){
-	return this->_calibration.dig_H2;
-}
-uint16_t BB_BME280::getCalibH3(void){
-	return (uint16_t) this->_calibration.dig_H3;
-}
-int16_t BB_BME280::getCalibH4(void){
-	return this->_calibration.dig_H4;
+
+uint32_t BB_BME280::getMaxMeasurementTime(void){
+	// t_max = 1.25 + 2.3 * T_osr + (2.3 * P_osr + 0.575) + (2.3 * H_osr + 0.575) ms
+	uint32_t t = 1250 + 2300UL * _oversampling(this->_settings.osrs_t);
+	if (this->_settings.osrs_p != BME280_osrs_p_SKIPPED){
+		t += 2300UL * _oversampling(this->_settings.osrs_p) + 575;
+	}
+	if (this->_settings.osrs_h != BME280_osrs_h_SKIPPED){
+		t += 2300UL * _oversampling(this->_settings.osrs_h) + 575;
+	}
+	return t;
 }
-int16_t BB_BME280::getCalibH5(void){
-	return this->_calibration.dig_H5;
+
+int8_t BB_BME280::readStatus(BB_BME280_STATUS &status){
+	uint8_t value;
+	if (this->_i2c->readbyte(STATUS, this->_i2cAddr, &value) != 1) return -1;
+	status.measuring = (value >> 3) & 0x01;
+	status.im_update = value & 0x01;
+	return 1;
 }
-int16_t BB_BME280::getCalibH6(void){
-	return (int16_t) this->_calibration.dig_H3;
+
+void BB_BME280::getCalibration(BB_BME280_CALIBRATION &calibration){
+	calibration = this->_calibration;
 }
 
 // private:
@@ -181,8 +222,24 @@ uint8_t BB_BME280::_i2cRead(BB_BME280_REGISTER registerAddr){
   return value;
 }
 
-void BB_BME280::_i2cWrite(BB_BME280_REGISTER registerAddr, uint8_t value){
-	this->_i2c->writebyte(registerAddr, this->_i2cAddr, value);
+int8_t BB_BME280::_i2cWrite(BB_BME280_REGISTER registerAddr, uint8_t value){
+	return this->_i2c->writebyte(registerAddr, this->_i2cAddr, value);
+}
+
+int8_t BB_BME280::_i2cReadBlock(BB_BME280_REGISTER registerAddr, uint8_t *data, uint8_t len){
+	return this->_i2c->readBlock(registerAddr, this->_i2cAddr, data, len);
+}
+
+uint8_t BB_BME280::_ctrlMeas(uint8_t mode){
+	return (uint8_t) (((this->_settings.osrs_t & 0x07) << 5) |
+	                  ((this->_settings.osrs_p & 0x07) << 2) |
+	                  (mode & 0x03));
+}
+
+uint8_t BB_BME280::_oversampling(uint8_t osrs){
+	if (osrs == 0) return 0;
+	if (osrs >= 5) return 16;  // 5, 6, 7: x16
+	return (uint8_t) (1 << (osrs - 1));
 }
 
 /**************************************************************************/
@@ -190,77 +247,58 @@ void BB_BME280::_i2cWrite(BB_BME280_REGISTER registerAddr, uint8_t value){
    @brief  Reads the factory-set coefficients
 */
 /**************************************************************************/
-void BB_BME280::_readCalibration(void){
-    uint8_t msb, lsb;
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_T1_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_T1_LSB + 1));
-    this->_calibration.dig_T1 = (uint16_t) ((((uint16_t) msb) << 8) | lsb);
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_T2_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_T2_LSB + 1));
-    this->_calibration.dig_T2 = (int16_t) ((((int16_t) msb) << 8) | lsb);
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_T3_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_T3_LSB + 1));
-    this->_calibration.dig_T3 = (int16_t) ((((int16_t) msb) << 8) | lsb);
-
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P1_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P1_LSB + 1));
-    this->_calibration.dig_P1 = (uint16_t) ((((uint16_t) msb) << 8) | lsb);
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P2_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P2_LSB + 1));
-    this->_calibration.dig_P2 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+int8_t BB_BME280::_readCalibration(void){
+    // 0x88 .. 0xA1: dig_T1 .. dig_P9, one reserved byte, dig_H1
+    uint8_t tp[BB_BME280_CALIBRATION_TP_SIZE];
+    // 0xE1 .. 0xE7: dig_H2 .. dig_H6
+    uint8_t h[BB_BME280_CALIBRATION_H_SIZE];
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P3_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P3_LSB + 1));
-    this->_calibration.dig_P3 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+    if (this->_i2cReadBlock((BB_BME280_REGISTER) CALIB_DIG_T1_LSB, tp, sizeof(tp)) != 1) return -1;
+    if (this->_i2cReadBlock((BB_BME280_REGISTER) CALIB_DIG_H2_LSB, h, sizeof(h)) != 1) return -1;
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P4_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P4_LSB + 1));
-    this->_calibration.dig_P4 = (int16_t) ((((int16_t) msb) << 8) | lsb);
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P5_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P5_LSB + 1));
-    this->_calibration.dig_P5 = (int16_t) ((((int16_t) msb) << 8) | lsb);
-
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P6_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P6_LSB + 1));
-    this->_calibration.dig_P6 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+    BB_BME280_parseCalibration(tp, h, this->_calibration);
+    return 1;
+}
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P7_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P7_LSB + 1));
-    this->_calibration.dig_P7 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+int8_t BB_BME280::_checkCalibration(void){
+    // 0x88 .. 0x8D: dig_T1 .. dig_T3
+    uint8_t t[CALIB_DIG_P1_LSB - CALIB_DIG_T1_LSB];
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P8_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P8_LSB + 1));
-    this->_calibration.dig_P8 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+    if (this->_i2cReadBlock((BB_BME280_REGISTER) CALIB_DIG_T1_LSB, t, sizeof(t)) != 1) return -1;
+    if ((this->_calibration.dig_T1 != (uint16_t) ((((uint16_t) t[1]) << 8) | t[0])) ||
+        (this->_calibration.dig_T2 != (int16_t) ((((int16_t) t[3]) << 8) | t[2])) ||
+        (this->_calibration.dig_T3 != (int16_t) ((((int16_t) t[5]) << 8) | t[4]))) return -1;
+    return 1;
+}
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_P9_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_P9_LSB + 1));
-    this->_calibration.dig_P9 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+int8_t BB_BME280::_loadCalibration(uint8_t chipId){
+	BB_BME280_CALIBRATION_CACHE cache;
 
+	if (chipId != BB_BME280_CHIPID) return -1;
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H1);
-    this->_calibration.dig_H1 = (uint8_t) lsb;
+	eeprom_read_block(&cache, (const void *) BB_BME280_EEPROM_ADDR, sizeof(cache));
+	if (cache.chipId != chipId) return -1;
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H2_LSB);
-    msb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_H2_LSB + 1));
-    this->_calibration.dig_H2 = (int16_t) ((((int16_t) msb) << 8) | lsb);
+	this->_calibration = cache.calibration;
+	if (this->_calibrationCrc(chipId) != cache.crc) return -1;
+	return 1;
+}
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H3);
-    this->_calibration.dig_H3 = (uint8_t) lsb;
+void BB_BME280::_storeCalibration(uint8_t chipId){
+	BB_BME280_CALIBRATION_CACHE cache;
 
-    msb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H4_MSB);
-    lsb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_H4_MSB + 1));
-    this->_calibration.dig_H4 = (int16_t) ((((int16_t) msb) << 4) | (0x0F & lsb));
+	cache.chipId = chipId;
+	cache.calibration = this->_calibration;
+	cache.crc = this->_calibrationCrc(chipId);
+	eeprom_update_block(&cache, (void *) BB_BME280_EEPROM_ADDR, sizeof(cache));
+}
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) (CALIB_DIG_H4_MSB + 1));
-    msb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H5_MSB);
-    this->_calibration.dig_H5 = (int16_t) ((((int16_t) msb) << 4) | (lsb >> 4));
+uint8_t BB_BME280::_calibrationCrc(uint8_t chipId){
+	const uint8_t *data = (const uint8_t *) &this->_calibration;
+	uint8_t crc = _crc_ibutton_update(BB_BME280_EEPROM_VERSION, chipId);
 
-    lsb = this->_i2cRead((BB_BME280_REGISTER) CALIB_DIG_H6);
-    this->_calibration.dig_H6 = (int8_t) lsb;
+	for (uint8_t n = 0; n < sizeof(this->_calibration); n++){
+		crc = _crc_ibutton_update(crc, data[n]);
+	}
+	return crc;
 }
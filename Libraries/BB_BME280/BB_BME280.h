@@ -10,16 +10,35 @@
 extern "C" {
 	#include <avr/io.h>
     #include <stdint.h>
+    #include <util/delay.h>
+    #include <util/crc16.h>
+    #include <avr/eeprom.h>
 }
 
 #ifndef BB_BME280_H_
 #define BB_BME280_H_
 
 #include <BB_I2C.h>
+#include "BB_BME280_COMPENSATION.h"
 
 // The I2C address of the sensor:
 #define BB_BME280_ADDRESS (0x76)
 
+// The fastest SCL clock of the sensor usable with the TWI
+// (high speed mode would need a master code)
+#define BB_BME280_MAX_SCL_CLOCK BB_I2C_FAST_MODE
+
+// The chip identification number of the BME280
+#define BB_BME280_CHIPID (0x60)
+
+// EEPROM area caching the calibration values (chip id, calibration, CRC)
+#ifndef BB_BME280_EEPROM_ADDR
+    #define BB_BME280_EEPROM_ADDR 0x0000
+#endif
+#define BB_BME280_EEPROM_SIZE 0x40
+// change if the layout of BB_BME280_CALIBRATION changes -> invalidates the cache
+#define BB_BME280_EEPROM_VERSION 2
+
 // Humidity oversampling osrs_h settings:
 #define BME280_osrs_h_SKIPPED	0
 #define BME280_osrs_h_x1		1
@@ -70,6 +89,12 @@ extern "C" {
 #define BME280_Filter_8		3
 #define BME280_Filter_16	(0x04)
 
+// recommended settings for typical use cases (datasheet, chapter 3.5):
+#define BME280_PROFILE_WEATHER_MONITORING	0	// forced, T/P/H x1, filter off
+#define BME280_PROFILE_HUMIDITY_SENSING		1	// forced, T/H x1, P skipped, filter off
+#define BME280_PROFILE_INDOOR_NAVIGATION	2	// normal 0.5ms, T x2, P x16, H x1, filter 16
+#define BME280_PROFILE_GAMING				3	// normal 0.5ms, T x1, P x4, H skipped, filter 16
+
 /**
  * Contains the all settings for the BME280
  */
@@ -83,15 +108,25 @@ struct BB_BME280_SETTINGS{
     uint8_t osrs_h;				// humidity oversampling
 };
 
-// TODO future implementation
-/*
+/**
+ * Contains one coherent sample of the BME280 (all values from the same
+ * conversion)
+ */
+struct BB_BME280_SAMPLE{
+    int32_t temperature;    // degC * 100
+    uint32_t pressure;      // hPa * 100
+    uint32_t humidity;      // % * 1024
+};
+
+/**
+ * Contains the status of the BME280
+ */
 struct BB_BME280_STATUS{
     uint8_t measuring;		// automatically set to 1 when conversation is running;
 							// back to 0 when results have been transferred.
     uint8_t im_update;		// automatically set to 1 when NVM data are being copied to image registers;
 							// back to 0 when copying is done.
 };
-*/
 
 //CALIBRATION REGISTER ADDRESS DEFINITIONS
 enum BB_BME280_REGISTER{
@@ -123,6 +158,7 @@ enum BB_BME280_REGISTER{
     CAL26 = 0xE1,  // R calibration stored in 0xE1-0xF0
 
     CONTROLHUMID = 0xF2,
+    STATUS = 0xF3,
     CONTROL = 0xF4,
     CONFIG = 0xF5,
 
@@ -131,39 +167,17 @@ enum BB_BME280_REGISTER{
     HUMIDITYDATA = 0xFD
 };
 
-/**
- * Contains the calibration values of the BME280
- */
-struct BB_BME280_CALIBRATION{
-    uint16_t dig_T1;		//temperature
-    int16_t dig_T2;			//temperature
-    int16_t dig_T3;			//temperature
-
-    uint16_t dig_P1;		//pressure
-    int16_t dig_P2;			//pressure
-    int16_t dig_P3;			//pressure
-    int16_t dig_P4;			//pressure
-    int16_t dig_P5;			//pressure
-    int16_t dig_P6;			//pressure
-    int16_t dig_P7;			//pressure
-    int16_t dig_P8;			//pressure
-    int16_t dig_P9;			//pressure
-
-    uint8_t dig_H1;			//humidity
-    int16_t dig_H2;			//humidity
-    uint8_t dig_H3;			//humidity
-    int16_t dig_H4;			//humidity
-    int16_t dig_H5;			//humidity
-    int8_t dig_H6;			//humidity
-};
-
 /**
  * Objects of this class represent a BME280
  */
 class BB_BME280{
     public:
 	    /**
-	     * Initializes a BME280 object.
+	     * Initializes a BME280 object. The calibration values are taken from
+	     * the EEPROM cache if it is valid. The chip id is the same for all
+	     * BME280, so the cache is only used if dig_T1 .. dig_T3 read from the
+	     * sensor match it - a replaced sensor is detected unless these values
+	     * are equal by chance. The cache is only written after a successful read.
 	     * @param i2c a reference to a I2C object.
 	     */
 	    BB_BME280(BB_I2C *i2c);
@@ -193,31 +207,83 @@ class BB_BME280{
          */
         uint32_t readHumidity(void);
 
-        // TODO implement methods for changing the settings
-        // TODO implement methods for reading settings
-        // TODO implement methods for reading status
-
-        // TODO implement improved method for reading calibration
-        //      the new version should have a struc as argument -> only one methode(!)
-        // no docu, because this preliminary code
-        uint16_t getCalibT1(void);
-        int16_t getCalibT2(void);
-        int16_t getCalibT3(void);
-        uint16_t getCalibP1(void);
-        int16_t getCalibP2(void);
-        int16_t getCalibP3(void);
-        int16_t getCalibP4(void);
-        int16_t getCalibP5(void);
-        int16_t getCalibP6(void);
-        int16_t getCalibP7(void);
-        int16_t getCalibP8(void);
-        int16_t getCalibP9(void);
-        uint16_t getCalibH1(void);
-        int16_t getCalibH2(void);
-        uint16_t getCalibH3(void);
-        int16_t getCalibH4(void);
-        int16_t getCalibH5(void);
-        int16_t getCalibH6(void);
+        /**
+         * Reads temperature, pressure and humidity with one burst read of the
+         * data registers (0xF7..0xFE). The data registers are shadowed during a
+         * burst read, so all three values belong to the same conversion.
+         * The burst read is queued for the interrupt driven engine of BB_I2C,
+         * the controller sleeps (idle) until it has finished. Must not be
+         * called from an ISR.
+         * @param sample contains the compensated values after the call
+         * @return 1 if I2C communication was successful
+         */
+        int8_t readAll(BB_BME280_SAMPLE &sample);
+
+        /**
+         * Triggers one conversion in forced mode. The sensor returns to sleep
+         * mode when the conversion is done. Nothing is done in normal mode,
+         * the sensor is converting continuously.
+         * @return 1 if I2C communication was successful
+         */
+        int8_t startMeasurement(void);
+
+        /**
+         * Checks if a conversion is running.
+         * @return 1 if the sensor is converting, 0 otherwise
+         */
+        uint8_t isMeasuring(void);
+
+        /**
+         * Triggers a conversion (forced mode), waits until the measuring status
+         * bit is cleared and reads the sample with readAll(). The waiting time is
+         * limited to getMaxMeasurementTime().
+         * @param sample contains the compensated values after the call
+         * @return 1 if successful, -1 on an I2C error or if the conversion timed out
+         */
+        int8_t measure(BB_BME280_SAMPLE &sample);
+
+        /**
+         * Provides the maximum time of one conversion for the current oversampling
+         * settings (datasheet, chapter 9.1).
+         * @return the maximum conversion time in us
+         */
+        uint32_t getMaxMeasurementTime(void);
+
+        /**
+         * Reads the status register of the BME280.
+         * @param status contains the status after the call
+         * @return 1 if I2C communication was successful
+         */
+        int8_t readStatus(BB_BME280_STATUS &status);
+
+        /**
+         * Writes all settings to the BME280 (ctrl_hum, ctrl_meas and config).
+         * The sensor is set to sleep mode while the config register is written.
+         * In forced mode the sensor stays in sleep mode until startMeasurement().
+         * @param settings the new settings
+         * @return 1 if I2C communication was successful
+         */
+        int8_t applySettings(const BB_BME280_SETTINGS &settings);
+
+        /**
+         * Writes the recommended settings of one use case to the BME280.
+         * @param profile one of BME280_PROFILE_X
+         * @return 1 if I2C communication was successful, -1 for an unknown profile
+         */
+        int8_t applyProfile(uint8_t profile);
+
+        /**
+         * Reads the settings from the registers of the BME280.
+         * @param settings contains the settings after the call
+         * @return 1 if I2C communication was successful
+         */
+        int8_t readSettings(BB_BME280_SETTINGS &settings);
+
+        /**
+         * Provides the calibration values of the BME280.
+         * @param calibration contains the calibration values after the call
+         */
+        void getCalibration(BB_BME280_CALIBRATION &calibration);
 
     private:
         /**
@@ -243,17 +309,25 @@ class BB_BME280{
 	     * This method pushes a value into one register of the BME280.
 	     * @param reg a register address on the BME280
 	     * @param value new data for the BME280 register
+	     * @return 1 if I2C communication was successful
 	     */
-	    void _i2cWrite(BB_BME280_REGISTER reg, uint8_t value);
+	    int8_t _i2cWrite(BB_BME280_REGISTER reg, uint8_t value);
+
+	    /**
+	     * A convenience method used to read consecutive registers of the BME280
+	     * within one I2C transaction (burst read).
+	     * @param reg the address of the first register on the BME280
+	     * @param data contains the register values after the transaction
+	     * @param len the number of registers to be read
+	     * @return 1 if I2C communication was successful
+	     */
+	    int8_t _i2cReadBlock(BB_BME280_REGISTER reg, uint8_t *data, uint8_t len);
 
 	    /**
 	     * Contains the current settings of the BME280.
 	     */
 	    struct BB_BME280_SETTINGS _settings;
 
-	    // TODO future implemenation
-	    //struct BB_BME280_STATUS _status;
-
 	    /**
 	     * Contains the calibration values of the BME280.
 	     */
@@ -261,9 +335,56 @@ class BB_BME280{
 
 	    /**
 	     * Reads the calibration values from the BME280 calibration register into
-	     * this->_calibration.
+	     * this->_calibration. The registers are fetched with two burst reads
+	     * (0x88..0xA1 and 0xE1..0xE7).
+	     * @return 1 if I2C communication was successful, -1 otherwise
+	     */
+	    int8_t _readCalibration(void);
+
+	    /**
+	     * Compares dig_T1 .. dig_T3 of the sensor with this->_calibration.
+	     * @return 1 if they match, -1 if they differ or I2C communication failed
+	     */
+	    int8_t _checkCalibration(void);
+
+	    /**
+	     * Loads the calibration values cached in the EEPROM into this->_calibration.
+	     * @param chipId the chip identification number read from the sensor
+	     * @return 1 if the cache is valid (chip id, version and CRC match), -1 otherwise
+	     */
+	    int8_t _loadCalibration(uint8_t chipId);
+
+	    /**
+	     * Stores this->_calibration in the EEPROM cache. Only changed bytes are written.
+	     * @param chipId the chip identification number read from the sensor
+	     */
+	    void _storeCalibration(uint8_t chipId);
+
+	    /**
+	     * Calculates the CRC protecting the EEPROM cache.
+	     * @param chipId the chip identification number
+	     * @return the CRC over version, chip id and this->_calibration
+	     */
+	    uint8_t _calibrationCrc(uint8_t chipId);
+
+	    /**
+	     * Composes the ctrl_meas register from the current settings.
+	     * @param mode the mode bits (BME280_MODE_X)
+	     * @return the value of the ctrl_meas register
+	     */
+	    uint8_t _ctrlMeas(uint8_t mode);
+
+	    /**
+	     * Converts an oversampling setting into the number of samples.
+	     * @param osrs an oversampling setting (BME280_osrs_X)
+	     * @return 0 (skipped), 1, 2, 4, 8 or 16
+	     */
+	    static uint8_t _oversampling(uint8_t osrs);
+
+	    /**
+	     * Contains the coefficients derived from the calibration values.
 	     */
-	    void _readCalibration(void);
+	    struct BB_BME280_COEFFICIENTS _coefficients;
 
 	    /**
 	     * A variable needed to calculate calibrated values for humidity, temperature, pressure.
@@ -0,0 +1,119 @@
+/*
+ * BB_BME280_COMPENSATION.cpp
+ *
+ *  Created on: Oct 14, 2016
+ *      Author: emit
+ */
+
+#include "BB_BME280_COMPENSATION.h"
+
+// The compensation follows the 32 bit integer formulas of the datasheet
+// (chapter 8.2) with bit-identical results. Sub-expressions depending on the
+// calibration only are taken from BB_BME280_COEFFICIENTS, repeated ones are
+// calculated once.
+
+void BB_BME280_parseCalibration(const uint8_t *tp, const uint8_t *h,
+                                BB_BME280_CALIBRATION &calibration){
+	calibration.dig_T1 = (uint16_t) ((((uint16_t) tp[1]) << 8) | tp[0]);
+	calibration.dig_T2 = (int16_t) ((((int16_t) tp[3]) << 8) | tp[2]);
+	calibration.dig_T3 = (int16_t) ((((int16_t) tp[5]) << 8) | tp[4]);
+
+	calibration.dig_P1 = (uint16_t) ((((uint16_t) tp[7]) << 8) | tp[6]);
+	calibration.dig_P2 = (int16_t) ((((int16_t) tp[9]) << 8) | tp[8]);
+	calibration.dig_P3 = (int16_t) ((((int16_t) tp[11]) << 8) | tp[10]);
+	calibration.dig_P4 = (int16_t) ((((int16_t) tp[13]) << 8) | tp[12]);
+	calibration.dig_P5 = (int16_t) ((((int16_t) tp[15]) << 8) | tp[14]);
+	calibration.dig_P6 = (int16_t) ((((int16_t) tp[17]) << 8) | tp[16]);
+	calibration.dig_P7 = (int16_t) ((((int16_t) tp[19]) << 8) | tp[18]);
+	calibration.dig_P8 = (int16_t) ((((int16_t) tp[21]) << 8) | tp[20]);
+	calibration.dig_P9 = (int16_t) ((((int16_t) tp[23]) << 8) | tp[22]);
+
+	// 0xA0 is reserved
+	calibration.dig_H1 = tp[25];
+
+	calibration.dig_H2 = (int16_t) ((((int16_t) h[1]) << 8) | h[0]);
+	calibration.dig_H3 = h[2];
+
+	// dig_H4 = 0xE4 [11:4] | 0xE5 [3:0], dig_H5 = 0xE6 [11:4] | 0xE5 [7:4]
+	calibration.dig_H4 = (int16_t) ((((int16_t) (int8_t) h[3]) * 16) | (0x0F & h[4]));
+	calibration.dig_H5 = (int16_t) ((((int16_t) (int8_t) h[5]) * 16) | (h[4] >> 4));
+
+	calibration.dig_H6 = (int8_t) h[6];
+}
+
+void BB_BME280_deriveCoefficients(const BB_BME280_CALIBRATION &calibration,
+                                  BB_BME280_COEFFICIENTS &coefficients){
+	coefficients.t1x2 = ((int32_t) calibration.dig_T1) * 2;
+	coefficients.p4s16 = ((int32_t) calibration.dig_P4) * 65536;
+	coefficients.p5x2 = ((int32_t) calibration.dig_P5) * 2;
+	coefficients.h4s20 = ((int32_t) calibration.dig_H4) * 1048576 - 16384;
+}
+
+int32_t BB_BME280_compensateTemperature(const BB_BME280_CALIBRATION &calibration,
+                                        const BB_BME280_COEFFICIENTS &coefficients,
+                                        int32_t adc_T, int32_t &t_fine){
+	int32_t x1_t = (((adc_T >> 3) - coefficients.t1x2) * ((int32_t) calibration.dig_T2)) >> 11;
+
+	int32_t d_t = (adc_T >> 4) - ((int32_t) calibration.dig_T1);
+	int32_t x2_t = (((d_t * d_t) >> 12) * ((int32_t) calibration.dig_T3)) >> 14;
+
+	t_fine = x1_t + x2_t;
+
+	int32_t temperature = (t_fine * 5 + 128) >> 8;
+	return temperature;
+}
+
+uint32_t BB_BME280_compensatePressure(const BB_BME280_CALIBRATION &calibration,
+                                      const BB_BME280_COEFFICIENTS &coefficients,
+                                      int32_t adc_P, int32_t t_fine){
+	int32_t x1_p = (t_fine >> 1) - (int32_t) 64000;
+	int32_t sq_p = (x1_p >> 2) * (x1_p >> 2);
+
+	int32_t x2_p = (sq_p >> 11) * ((int32_t) calibration.dig_P6);
+	x2_p = x2_p + x1_p * coefficients.p5x2;
+	x2_p = (x2_p >> 2) + coefficients.p4s16;
+
+	x1_p = (((((int32_t) calibration.dig_P3) * (sq_p >> 13)) >> 3) +
+	        ((((int32_t) calibration.dig_P2) * x1_p) >> 1)) >> 18;
+
+	x1_p = ((32768 + x1_p) * ((int32_t) calibration.dig_P1)) >> 15;
+
+	/* Avoid exception caused by division by zero */
+	if (x1_p == 0) return 0;
+
+	uint32_t pressure = (((uint32_t)(((int32_t) 1048576) - adc_P) - (x2_p >> 12))) * 3125;
+	if (pressure < 0x80000000){
+		pressure = (pressure << 1) / ((uint32_t) x1_p);
+	} else {
+		pressure = (pressure / ((uint32_t) x1_p)) * 2;
+	}
+
+	x1_p = (((int32_t) calibration.dig_P9) *
+	        ((int32_t) (((pressure >> 3) * (pressure >> 3)) >> 13))) >> 12;
+	x2_p = (((int32_t) (pressure >> 2)) * ((int32_t) calibration.dig_P8)) >> 13;
+	pressure = (uint32_t) ((int32_t) pressure + ((x1_p + x2_p + calibration.dig_P7) >> 4));
+
+	return pressure;
+}
+
+uint32_t BB_BME280_compensateHumidity(const BB_BME280_CALIBRATION &calibration,
+                                      const BB_BME280_COEFFICIENTS &coefficients,
+                                      int32_t adc_H, int32_t t_fine){
+  int32_t v_x1_u32r;
+
+  v_x1_u32r = (t_fine - ((int32_t)76800));
+
+  v_x1_u32r = ((((adc_H << 14) - coefficients.h4s20 -
+		  (((int32_t) calibration.dig_H5) * v_x1_u32r)) >> 15) *
+	       (((((((v_x1_u32r * ((int32_t) calibration.dig_H6)) >> 10) *
+		    (((v_x1_u32r * ((int32_t) calibration.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+		  ((int32_t)2097152)) * ((int32_t) calibration.dig_H2) + 8192) >> 14));
+
+  v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
+			     ((int32_t) calibration.dig_H1)) >> 4));
+
+  v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
+  v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
+
+  return (uint32_t) (v_x1_u32r>>12);
+}
@@ -0,0 +1,114 @@
+/**
+ * BB_BME280_COMPENSATION.h - The compensation formulas of the BME280. They
+ * convert the raw ADC values into temperature, pressure and humidity.
+ * This part of the library depends on stdint.h only, so it can be built
+ * and verified on any host.
+ *
+ *  Created on: Oct 14, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+#include <stdint.h>
+
+#ifndef BB_BME280_COMPENSATION_H_
+#define BB_BME280_COMPENSATION_H_
+
+/**
+ * Contains the calibration values of the BME280
+ */
+struct BB_BME280_CALIBRATION{
+    uint16_t dig_T1;		//temperature
+    int16_t dig_T2;			//temperature
+    int16_t dig_T3;			//temperature
+
+    uint16_t dig_P1;		//pressure
+    int16_t dig_P2;			//pressure
+    int16_t dig_P3;			//pressure
+    int16_t dig_P4;			//pressure
+    int16_t dig_P5;			//pressure
+    int16_t dig_P6;			//pressure
+    int16_t dig_P7;			//pressure
+    int16_t dig_P8;			//pressure
+    int16_t dig_P9;			//pressure
+
+    uint8_t dig_H1;			//humidity
+    int16_t dig_H2;			//humidity
+    uint8_t dig_H3;			//humidity
+    int16_t dig_H4;			//humidity
+    int16_t dig_H5;			//humidity
+    int8_t dig_H6;			//humidity
+};
+
+// the calibration registers are read in two blocks
+#define BB_BME280_CALIBRATION_TP_SIZE 26  // 0x88 .. 0xA1: dig_T1 .. dig_P9, reserved, dig_H1
+#define BB_BME280_CALIBRATION_H_SIZE 7    // 0xE1 .. 0xE7: dig_H2 .. dig_H6
+
+/**
+ * Contains coefficients derived once from the calibration values. They replace
+ * the sub-expressions of the compensation formulas which depend on the
+ * calibration only.
+ */
+struct BB_BME280_COEFFICIENTS{
+    int32_t t1x2;           // dig_T1 * 2
+    int32_t p4s16;          // dig_P4 * 2^16
+    int32_t p5x2;           // dig_P5 * 2
+    int32_t h4s20;          // dig_H4 * 2^20 - 16384 (rounding offset)
+};
+
+/**
+ * Converts the content of the calibration registers into the calibration values.
+ * dig_H4 and dig_H5 are signed 12 bit values sharing the nibbles of register 0xE5.
+ * @param tp the registers 0x88 .. 0xA1, BB_BME280_CALIBRATION_TP_SIZE bytes
+ * @param h the registers 0xE1 .. 0xE7, BB_BME280_CALIBRATION_H_SIZE bytes
+ * @param calibration contains the calibration values after the call
+ */
+void BB_BME280_parseCalibration(const uint8_t *tp, const uint8_t *h,
+                                BB_BME280_CALIBRATION &calibration);
+
+/**
+ * Derives the coefficients from the calibration values. Has to be called
+ * whenever the calibration values change.
+ * @param calibration the calibration values of the sensor
+ * @param coefficients contains the derived coefficients after the call
+ */
+void BB_BME280_deriveCoefficients(const BB_BME280_CALIBRATION &calibration,
+                                  BB_BME280_COEFFICIENTS &coefficients);
+
+/**
+ * Calculates the temperature from the raw ADC value.
+ * @param calibration the calibration values of the sensor
+ * @param coefficients the coefficients derived from the calibration values
+ * @param adc_T the raw temperature value (20 bit)
+ * @param t_fine contains the fine temperature needed by pressure and humidity after the call
+ * @return the temperature value in degC * 100
+ */
+int32_t BB_BME280_compensateTemperature(const BB_BME280_CALIBRATION &calibration,
+                                        const BB_BME280_COEFFICIENTS &coefficients,
+                                        int32_t adc_T, int32_t &t_fine);
+
+/**
+ * Calculates the pressure from the raw ADC value.
+ * @param calibration the calibration values of the sensor
+ * @param coefficients the coefficients derived from the calibration values
+ * @param adc_P the raw pressure value (20 bit)
+ * @param t_fine the fine temperature of the same sample
+ * @return the pressure value in hPa * 100
+ */
+uint32_t BB_BME280_compensatePressure(const BB_BME280_CALIBRATION &calibration,
+                                      const BB_BME280_COEFFICIENTS &coefficients,
+                                      int32_t adc_P, int32_t t_fine);
+
+/**
+ * Calculates the humidity from the raw ADC value.
+ * @param calibration the calibration values of the sensor
+ * @param coefficients the coefficients derived from the calibration values
+ * @param adc_H the raw humidity value (16 bit)
+ * @param t_fine the fine temperature of the same sample
+ * @return the humidity value in % * 1024
+ */
+uint32_t BB_BME280_compensateHumidity(const BB_BME280_CALIBRATION &calibration,
+                                      const BB_BME280_COEFFICIENTS &coefficients,
+                                      int32_t adc_H, int32_t t_fine);
+
+#endif /* BB_BME280_COMPENSATION_H_ */
@@ -7,15 +7,282 @@
 
 #include "BB_I2C.h"
 
+// state of the interrupt driven engine (there is only one TWI)
+
+// ring buffer of the queued transactions, _queue[_queueHead] is the active one
+static BB_I2C_TRANSACTION * volatile _queue[BB_I2C_QUEUE_SIZE];
+static volatile uint8_t _queueHead = 0;
+static volatile uint8_t _queueCount = 0;
+// number of data bytes of the active transaction transferred so far
+static volatile uint8_t _dataIndex = 0;
+// number of repetitions of the active transaction
+static volatile uint8_t _attempts = 0;
+
+// error counters, shared by the blocking and the interrupt driven transfers
+static BB_I2C_ERRORS _errors = {0, 0, 0, 0, 0, 0};
+
+// TWCR values used by the engine
+#define TWCR_ISR_START ((1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE))
+#define TWCR_ISR_NEXT  ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+#define TWCR_ISR_ACK   ((1 << TWINT) | (1 << TWEN) | (1 << TWIE) | (1 << TWEA))
+#define TWCR_ISR_STOP  ((1 << TWINT) | (1 << TWEN) | (1 << TWSTO))
+
+// Timer2 (prescaler 1024) watches the engine: compare match after BB_I2C_TIMEOUT_US
+#define TIMER2_TIMEOUT_TICKS ((F_CPU / 1024UL) * BB_I2C_TIMEOUT_US / 1000000UL)
+#if (TIMER2_TIMEOUT_TICKS < 1) || (TIMER2_TIMEOUT_TICKS > 255)
+    #error "BB_I2C_TIMEOUT_US can not be measured by Timer2 at this F_CPU"
+#endif
+
+/**
+ * Counts one error by its TWI status.
+ */
+static void _countError(uint8_t twi_status){
+	switch(twi_status){
+		case TW_MT_SLA_NACK:
+		case TW_MR_SLA_NACK:
+		case TW_MT_DATA_NACK:
+			_errors.nack++;
+		break;
+		case TW_MT_ARB_LOST:
+			_errors.arbitrationLost++;
+		break;
+		case TW_BUS_ERROR:
+			_errors.busError++;
+		break;
+		case I2C_TIMEOUT:
+			_errors.timeout++;
+		break;
+	}
+}
+
+/**
+ * Bus clear sequence: SCL is clocked up to 9 times until the slave releases
+ * SDA, then a STOP condition is generated. The TWI is disabled afterwards.
+ * @return 1 if SDA and SCL are high afterwards, -1 otherwise
+ */
+static int8_t _busClear(void){
+	uint8_t n;
+
+	// take over the pins from the TWI, both lines released (input, pull-up)
+	TWCR = 0;
+	DDRC &= ~((1 << BB_I2C_SDA) | (1 << BB_I2C_SCL));
+	PORTC |= (1 << BB_I2C_SDA) | (1 << BB_I2C_SCL);
+	_delay_us(5);
+
+	for (n = 0; (n < 9) && !(PINC & (1 << BB_I2C_SDA)); n++){
+		// SCL low (open drain emulation: pull-up off, then output)
+		PORTC &= ~(1 << BB_I2C_SCL);
+		DDRC |= (1 << BB_I2C_SCL);
+		_delay_us(5);
+		// SCL released
+		DDRC &= ~(1 << BB_I2C_SCL);
+		PORTC |= (1 << BB_I2C_SCL);
+		_delay_us(5);
+	}
+
+	// STOP condition: SDA low -> high while SCL is high
+	PORTC &= ~(1 << BB_I2C_SDA);
+	DDRC |= (1 << BB_I2C_SDA);
+	_delay_us(5);
+	DDRC &= ~(1 << BB_I2C_SDA);
+	PORTC |= (1 << BB_I2C_SDA);
+	_delay_us(5);
+
+	_errors.recoveries++;
+
+	if ((PINC & (1 << BB_I2C_SDA)) && (PINC & (1 << BB_I2C_SCL))) return 1;
+	return -1;
+}
+
+static void _timeoutStart(void){
+	TCCR2B = 0;
+	TCNT2 = 0;
+	OCR2A = TIMER2_TIMEOUT_TICKS;
+	TCCR2A = (1 << WGM21);                           // CTC mode
+	TIFR2 = (1 << OCF2A);
+	TIMSK2 = (1 << OCIE2A);
+	TCCR2B = (1 << CS22) | (1 << CS21) | (1 << CS20); // prescaler 1024
+}
 
-BB_I2C::BB_I2C(){
+static void _timeoutStop(void){
+	TCCR2B = 0;
+	TIMSK2 = 0;
+}
+
+/**
+ * Finishes the active transaction and starts the next queued one.
+ * Only called from the ISRs.
+ */
+static void _finishTransaction(uint8_t status){
+	BB_I2C_TRANSACTION *t = _queue[_queueHead];
+
+	_queueHead = (_queueHead + 1) % BB_I2C_QUEUE_SIZE;
+	_queueCount--;
+	_dataIndex = 0;
+	_attempts = 0;
+
+	if (status != BB_I2C_STATUS_DONE) _errors.failed++;
+
+	if (_queueCount > 0){
+		// STOP followed by a START for the next transaction
+		_queue[_queueHead]->status = BB_I2C_STATUS_BUSY;
+		TWCR = TWCR_ISR_START | (1 << TWSTO);
+		TCNT2 = 0;
+	} else {
+		// STOP and release the TWI (interrupt disabled)
+		TWCR = TWCR_ISR_STOP;
+		_timeoutStop();
+	}
+
+	t->status = status;
+	if (t->callback) t->callback(t);
+}
+
+ISR(TWI_vect){
+	BB_I2C_TRANSACTION *t = _queue[_queueHead];
+	uint8_t twi_status = TW_STATUS;
+
+	// the bus is alive -> restart the timeout
+	TCNT2 = 0;
+
+	switch(twi_status){
+		case TW_START:
+			// Send slave address (SLA_W), the register address is always written first
+			TWDR = (t->devAddr << 1) | TW_WRITE;
+			TWCR = TWCR_ISR_NEXT;
+		break;
+		case TW_REP_START:
+			// Send slave address (SLA_R) after the register address was sent
+			TWDR = (t->devAddr << 1) | TW_READ;
+			TWCR = TWCR_ISR_NEXT;
+		break;
+		case TW_MT_SLA_ACK:
+			// Send the address of the first register
+			TWDR = t->regAddr;
+			TWCR = TWCR_ISR_NEXT;
+		break;
+		case TW_MT_DATA_ACK:
+			if (t->direction == BB_I2C_READ){
+				// register address sent -> repeated start for reading
+				TWCR = TWCR_ISR_START;
+			} else if (_dataIndex < t->len){
+				TWDR = t->data[_dataIndex++];
+				TWCR = TWCR_ISR_NEXT;
+			} else {
+				_finishTransaction(BB_I2C_STATUS_DONE);
+			}
+		break;
+		case TW_MR_SLA_ACK:
+			// ACK all bytes but the last one
+			TWCR = (t->len > 1) ? TWCR_ISR_ACK : TWCR_ISR_NEXT;
+		break;
+		case TW_MR_DATA_ACK:
+			t->data[_dataIndex++] = TWDR;
+			TWCR = (_dataIndex < t->len - 1) ? TWCR_ISR_ACK : TWCR_ISR_NEXT;
+		break;
+		case TW_MR_DATA_NACK:
+			t->data[_dataIndex++] = TWDR;
+			_finishTransaction(BB_I2C_STATUS_DONE);
+		break;
+		case TW_MT_SLA_NACK:
+		case TW_MR_SLA_NACK:
+		case TW_MT_ARB_LOST:
+			// Restart the transaction (as soon as the bus is free) within the retry budget.
+			// STOP first: a repeated start would be taken for the read phase.
+			_countError(twi_status);
+			if (_attempts < BB_I2C_RETRIES){
+				_attempts++;
+				_dataIndex = 0;
+				TWCR = TWCR_ISR_START | (1 << TWSTO);
+			} else {
+				_finishTransaction(BB_I2C_STATUS_ERROR);
+			}
+		break;
+		default:
+			// data NACK, bus error
+			_countError(twi_status);
+			if (twi_status == TW_BUS_ERROR) _busClear();
+			_finishTransaction(BB_I2C_STATUS_ERROR);
+		break;
+	}
+}
+
+ISR(TIMER2_COMPA_vect){
+	// no TWI interrupt within BB_I2C_TIMEOUT_US -> abort the active transaction
+	_timeoutStop();
+	if (_queueCount == 0) return;
+	_countError(I2C_TIMEOUT);
+	_busClear();
+	_finishTransaction(BB_I2C_STATUS_TIMEOUT);
+	if (_queueCount > 0) _timeoutStart();
+}
+
+BB_I2C::BB_I2C(uint32_t sclClock){
+	// 0 can not be generated -> default clock
+	this->_sclClock = (sclClock > 0) ? sclClock : SCL_CLOCK;
+	this->_deviceCount = 0;
 	this->_init();
 }
 
+int8_t BB_I2C::setClock(uint32_t sclClock){
+	if (sclClock == 0) return -1;
+	this->_sclClock = sclClock;
+	return this->_applyClock();
+}
+
+uint32_t BB_I2C::getClock(void){
+	// SCL = F_CPU / (16 + 2 * TWBR * 4^TWPS)
+	return F_CPU / (16 + 2UL * TWBR * (1 << (2 * (TWSR & ((1 << TWPS1) | (1 << TWPS0))))));
+}
+
+int8_t BB_I2C::setDeviceClock(uint8_t dev_addr, uint32_t maxSclClock){
+	uint8_t n;
+
+	if (maxSclClock == 0) return -1;
+
+	for (n = 0; n < this->_deviceCount; n++){
+		if (this->_deviceAddr[n] == dev_addr) break;
+	}
+	if (n == BB_I2C_MAX_DEVICES) return -1;
+	if (n == this->_deviceCount) this->_deviceCount++;
+
+	this->_deviceAddr[n] = dev_addr;
+	this->_deviceClock[n] = maxSclClock;
+	return this->_applyClock();
+}
+
 int8_t BB_I2C::_init(){
-	TWSR = 0x00;    //set Prescaler to faktor 1
-	TWBR = ((F_CPU/SCL_CLOCK)-16)/2; /* must be > 10 for stable operation */
-	return 0;
+	return this->_applyClock();
+}
+
+int8_t BB_I2C::_applyClock(void){
+	uint32_t sclClock = this->_sclClock;
+	uint32_t twbr;
+	uint8_t prescaler;
+	uint8_t n;
+
+	// the slowest slave limits the bus
+	for (n = 0; n < this->_deviceCount; n++){
+		if (this->_deviceClock[n] < sclClock) sclClock = this->_deviceClock[n];
+	}
+
+	if (sclClock > F_CPU / 16) sclClock = F_CPU / 16;
+
+	// smallest prescaler (1, 4, 16, 64) giving TWBR <= 255, round TWBR up
+	// so the resulting clock does not exceed sclClock
+	for (prescaler = 0; prescaler < 4; prescaler++){
+		uint16_t factor = 2 * (1 << (2 * prescaler));
+		twbr = ((F_CPU / sclClock) - 16 + factor - 1) / factor;
+		if (twbr <= 255) break;
+	}
+	if (prescaler == 4) return -1;
+
+	// the engine must not be disturbed while transferring
+	this->_waitIdle();
+
+	TWSR = prescaler;           // TWPS1, TWPS0; status bits are read-only
+	TWBR = (uint8_t) twbr;
+	return 1;
 }
 
 uint8_t BB_I2C::_transmit(uint8_t type){
@@ -23,26 +290,37 @@ uint8_t BB_I2C::_transmit(uint8_t type){
 		case I2C_START:    // Send Start Condition
 		TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
 		break;
-		case I2C_DATA:     // Send Data
+		case I2C_DATA:     // Send Data / receive data and reply with NACK
 		TWCR = (1 << TWINT) | (1 << TWEN);
 		break;
+		case I2C_DATA_ACK: // Receive data and reply with ACK
+		TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWEA);
+		break;
 		case I2C_STOP:     // Send Stop Condition
 		TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
 		return 0;
 	}
-	// Wait for TWINT flag set in TWCR Register
-	while (!(TWCR & (1 << TWINT)));
+	// Wait for TWINT flag set in TWCR Register, give up after BB_I2C_TIMEOUT_US
+	uint16_t timeout = BB_I2C_TIMEOUT_US;
+	while (!(TWCR & (1 << TWINT))){
+		if (timeout-- == 0) return I2C_TIMEOUT;
+		_delay_us(1);
+	}
 	// Return TWI Status Register, mask the prescaler bits (TWPS1,TWPS0)
 	return (TWSR & 0xF8);
 }
 
 int8_t BB_I2C::writebyte(uint8_t reg_address, uint8_t dev_addr, uint8_t data){
-	//unsigned char n = 0;
-	unsigned char twi_status;
+	unsigned char twi_status = 0;
 	char r_val = -1;
+	uint8_t attempts = 0;
+
+	this->_waitIdle();
 
 	I2C_retry:
 
+	if (!this->_retry(twi_status, &attempts)) goto I2C_quit;
+
 	// Transmit Start Condition
 	twi_status = this->_transmit(I2C_START);
 
@@ -73,20 +351,26 @@ int8_t BB_I2C::writebyte(uint8_t reg_address, uint8_t dev_addr, uint8_t data){
 
 	I2C_quit:
 
-	// Transmit I2C Data
-	twi_status = this->_transmit(I2C_STOP);
+	if (r_val != 1) this->_fail(twi_status);
+
+	// Send Stop Condition
+	this->_transmit(I2C_STOP);
 
 	_delay_us(10);
 	return r_val;
 }
 
 int8_t BB_I2C::readbyte(uint8_t reg_address, uint8_t dev_addr, uint8_t* data){
-	//unsigned char n = 0;
-	unsigned char twi_status;
+	unsigned char twi_status = 0;
 	char r_val = -1;
+	uint8_t attempts = 0;
+
+	this->_waitIdle();
 
 	I2C_retry:
 
+	if (!this->_retry(twi_status, &attempts)) goto I2C_quit;
+
 	// Transmit Start Condition
 	twi_status = this->_transmit(I2C_START);
 
@@ -139,10 +423,280 @@ int8_t BB_I2C::readbyte(uint8_t reg_address, uint8_t dev_addr, uint8_t* data){
 
 	I2C_quit:
 
+	if (r_val != 1) this->_fail(twi_status);
+
 	// Send Stop Condition
-	twi_status = this->_transmit(I2C_STOP);
+	this->_transmit(I2C_STOP);
 
 	_delay_us(10);
 
 	return r_val;
 }
+
+int8_t BB_I2C::writeBlock(uint8_t reg_address, uint8_t dev_addr, const uint8_t* data, uint8_t len){
+	unsigned char twi_status = 0;
+	char r_val = -1;
+	uint8_t attempts = 0;
+	uint8_t n;
+
+	if (len == 0) return r_val;
+
+	this->_waitIdle();
+
+	I2C_retry:
+
+	if (!this->_retry(twi_status, &attempts)) goto I2C_quit;
+
+	// Transmit Start Condition
+	twi_status = this->_transmit(I2C_START);
+
+	// Check the TWI Status
+	if (twi_status == TW_MT_ARB_LOST) goto I2C_retry;
+	if ((twi_status != TW_START) && (twi_status != TW_REP_START)) goto I2C_quit;
+	// Send slave address (SLA_W)
+	TWDR = (dev_addr << 1) | TW_WRITE;
+	// Transmit I2C Data
+	twi_status = this->_transmit(I2C_DATA);
+	// Check the TWSR status
+	if ((twi_status == TW_MT_SLA_NACK) || (twi_status == TW_MT_ARB_LOST)) goto I2C_retry;
+	if (twi_status != TW_MT_SLA_ACK) goto I2C_quit;
+	// Send the address of the first register, the slave increments it
+	TWDR = reg_address;
+	// Transmit I2C Data
+	twi_status = this->_transmit(I2C_DATA);
+	// Check the TWSR status
+	if (twi_status != TW_MT_DATA_ACK) goto I2C_quit;
+	// Send all data bytes, each one has to be acknowledged by the slave
+	for (n = 0; n < len; n++){
+		TWDR = data[n];
+		twi_status = this->_transmit(I2C_DATA);
+		if (twi_status != TW_MT_DATA_ACK) goto I2C_quit;
+	}
+	// TWI Transmit Ok
+	r_val=1;
+
+	I2C_quit:
+
+	if (r_val != 1) this->_fail(twi_status);
+
+	// Send Stop Condition
+	this->_transmit(I2C_STOP);
+
+	_delay_us(10);
+	return r_val;
+}
+
+int8_t BB_I2C::readBlock(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len){
+	unsigned char twi_status = 0;
+	char r_val = -1;
+	uint8_t attempts = 0;
+	uint8_t n;
+
+	if (len == 0) return r_val;
+
+	this->_waitIdle();
+
+	I2C_retry:
+
+	if (!this->_retry(twi_status, &attempts)) goto I2C_quit;
+
+	// Transmit Start Condition
+	twi_status = this->_transmit(I2C_START);
+
+	// Check the TWSR status
+	if (twi_status == TW_MT_ARB_LOST) goto I2C_retry;
+	if ((twi_status != TW_START) && (twi_status != TW_REP_START)) goto I2C_quit;
+
+	// Send slave address (SLA_W)
+	TWDR = (dev_addr << 1) | TW_WRITE;
+
+	// Transmit I2C Data
+	twi_status = this->_transmit(I2C_DATA);
+
+	// Check the TWSR status
+	if ((twi_status == TW_MT_SLA_NACK) || (twi_status == TW_MT_ARB_LOST)) goto I2C_retry;
+	if (twi_status != TW_MT_SLA_ACK) goto I2C_quit;
+
+	// Send the address of the first register
+	TWDR = reg_address;
+
+	// Transmit I2C Data
+	twi_status = this->_transmit(I2C_DATA);
+
+	// Check the TWSR status
+	if (twi_status != TW_MT_DATA_ACK) goto I2C_quit;
+
+	// Send repeated start Condition
+	twi_status = this->_transmit(I2C_START);
+
+	// Check the TWSR status
+	if (twi_status == TW_MT_ARB_LOST) goto I2C_retry;
+	if ((twi_status != TW_START) && (twi_status != TW_REP_START)) goto I2C_quit;
+
+	// Send slave address (SLA_R)
+	TWDR = (dev_addr << 1) | TW_READ;
+
+	// Transmit I2C Data
+	twi_status = this->_transmit(I2C_DATA);
+	// Check the TWSR status
+	if ((twi_status == TW_MR_SLA_NACK) || (twi_status == TW_MR_ARB_LOST)) goto I2C_retry;
+	if (twi_status != TW_MR_SLA_ACK) goto I2C_quit;
+
+	// Read all bytes but the last one and acknowledge them -> the slave
+	// continues with the next register
+	for (n = 0; n < len - 1; n++){
+		twi_status = this->_transmit(I2C_DATA_ACK);
+		if (twi_status != TW_MR_DATA_ACK) goto I2C_quit;
+		data[n] = TWDR;
+	}
+
+	// Read the last byte and reply with NACK -> end of the transfer
+	twi_status = this->_transmit(I2C_DATA);
+	if (twi_status != TW_MR_DATA_NACK) goto I2C_quit;
+	data[n] = TWDR;
+	r_val=1;
+
+	I2C_quit:
+
+	if (r_val != 1) this->_fail(twi_status);
+
+	// Send Stop Condition
+	this->_transmit(I2C_STOP);
+
+	_delay_us(10);
+
+	return r_val;
+}
+
+int8_t BB_I2C::readBlockAsync(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len,
+                              BB_I2C_TRANSACTION *transaction,
+                              void (*callback)(BB_I2C_TRANSACTION *transaction)){
+	transaction->devAddr = dev_addr;
+	transaction->regAddr = reg_address;
+	transaction->data = data;
+	transaction->len = len;
+	transaction->direction = BB_I2C_READ;
+	transaction->callback = callback;
+	return this->queue(transaction);
+}
+
+int8_t BB_I2C::writeBlockAsync(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len,
+                               BB_I2C_TRANSACTION *transaction,
+                               void (*callback)(BB_I2C_TRANSACTION *transaction)){
+	transaction->devAddr = dev_addr;
+	transaction->regAddr = reg_address;
+	transaction->data = data;
+	transaction->len = len;
+	transaction->direction = BB_I2C_WRITE;
+	transaction->callback = callback;
+	return this->queue(transaction);
+}
+
+int8_t BB_I2C::queue(BB_I2C_TRANSACTION *transaction){
+	int8_t r_val = -1;
+	uint8_t start = 0;
+
+	if (transaction->len == 0){
+		transaction->status = BB_I2C_STATUS_ERROR;
+		return r_val;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (_queueCount < BB_I2C_QUEUE_SIZE){
+			transaction->status = BB_I2C_STATUS_PENDING;
+			_queue[(_queueHead + _queueCount) % BB_I2C_QUEUE_SIZE] = transaction;
+			_queueCount++;
+			start = (_queueCount == 1) ? 1 : 0;
+			r_val = 1;
+		}
+	}
+	if (start){
+		// the engine is idle, its interrupts are off -> wait for the last STOP
+		// with the interrupts of the caller and kick it off
+		uint16_t timeout = BB_I2C_TIMEOUT_US;
+		while (TWCR & (1 << TWSTO)){
+			if (timeout-- == 0){
+				// the STOP hangs -> clear the bus, Timer2 watches the new START
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+					_countError(I2C_TIMEOUT);
+				}
+				this->recoverBus();
+				break;
+			}
+			_delay_us(1);
+		}
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			transaction->status = BB_I2C_STATUS_BUSY;
+			_timeoutStart();
+			TWCR = TWCR_ISR_START;
+		}
+	}
+	return r_val;
+}
+
+int8_t BB_I2C::wait(BB_I2C_TRANSACTION *transaction){
+	uint8_t sreg = SREG;
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while (transaction->status < BB_I2C_STATUS_DONE){
+		// sei() enables the interrupts only after the next instruction
+		// -> no interrupt is lost between the check and sleep_cpu()
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	// restore the interrupt state of the caller
+	SREG = sreg;
+	return (transaction->status == BB_I2C_STATUS_DONE) ? 1 : -1;
+}
+
+uint8_t BB_I2C::isBusy(void){
+	return (_queueCount > 0) ? 1 : 0;
+}
+
+int8_t BB_I2C::recoverBus(void){
+	int8_t r_val;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		r_val = _busClear();
+	}
+	// give the pins back to the TWI
+	TWCR = (1 << TWEN);
+	return r_val;
+}
+
+void BB_I2C::getErrors(BB_I2C_ERRORS *errors){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		*errors = _errors;
+	}
+}
+
+void BB_I2C::clearErrors(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		_errors = (BB_I2C_ERRORS) {0, 0, 0, 0, 0, 0};
+	}
+}
+
+void BB_I2C::_waitIdle(void){
+	// bounded by the Timer2 timeout of the engine
+	while (_queueCount > 0);
+}
+
+uint8_t BB_I2C::_retry(uint8_t twi_status, uint8_t *attempts){
+	// first attempt
+	if ((*attempts)++ == 0) return 1;
+	// retry budget exhausted, the error is counted by _fail()
+	if (*attempts > BB_I2C_RETRIES + 1) return 0;
+	_countError(twi_status);
+	return 1;
+}
+
+void BB_I2C::_fail(uint8_t twi_status){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		_countError(twi_status);
+		_errors.failed++;
+	}
+	if ((twi_status == I2C_TIMEOUT) || (twi_status == TW_BUS_ERROR)) this->recoverBus();
+}
@@ -11,6 +11,9 @@ extern "C" {
     #include <stdint.h>
     #include <util/twi.h>
     #include <util/delay.h>
+    #include <util/atomic.h>
+    #include <avr/interrupt.h>
+    #include <avr/sleep.h>
 }
 
 #ifndef BB_I2C_H_
@@ -20,28 +23,137 @@ extern "C" {
     #define F_CPU 8000000UL
 #endif
 
+// I2C bus speeds
+#define BB_I2C_STANDARD_MODE   100000UL
+#define BB_I2C_FAST_MODE       400000UL
+#define BB_I2C_FAST_MODE_PLUS 1000000UL
+
+// default SCL clock
 #ifndef SCL_CLOCK
-    #define SCL_CLOCK 100000L
+    #define SCL_CLOCK BB_I2C_STANDARD_MODE
+#endif
+
+// TWBR value for a SCL clock and a TWI prescaler (1, 4, 16, 64)
+#define BB_I2C_TWBR(scl, prescaler) (((F_CPU / (scl)) - 16) / (2 * (prescaler)))
+
+#if (F_CPU / SCL_CLOCK) < 16
+    #error "SCL_CLOCK can not be generated at this F_CPU (maximum is F_CPU / 16)"
+#elif BB_I2C_TWBR(SCL_CLOCK, 64) > 255
+    #error "SCL_CLOCK can not be generated at this F_CPU (TWBR > 255 at prescaler 64)"
+#endif
+
+// number of slaves with an individual maximum SCL clock
+#ifndef BB_I2C_MAX_DEVICES
+    #define BB_I2C_MAX_DEVICES 4
 #endif
 
 #define I2C_START 0
 #define I2C_DATA  1
 #define I2C_STOP  2
+#define I2C_DATA_ACK 3
+
+// pseudo TWI status returned by _transmit() if TWINT was not set in time
+#define I2C_TIMEOUT 0xFF
+
+// upper limit for each bus step (START, one byte, ...) in us
+#ifndef BB_I2C_TIMEOUT_US
+    #define BB_I2C_TIMEOUT_US 2000
+#endif
+
+// number of repetitions after a NACK of the slave address or a lost arbitration
+#ifndef BB_I2C_RETRIES
+    #define BB_I2C_RETRIES 3
+#endif
+
+// the TWI pins of the Atmega328P (used for the bus clear sequence)
+#define BB_I2C_SDA PC4
+#define BB_I2C_SCL PC5
+
+// number of transactions which can be queued for the interrupt driven engine
+#ifndef BB_I2C_QUEUE_SIZE
+    #define BB_I2C_QUEUE_SIZE 4
+#endif
+
+// direction of a queued transaction
+#define BB_I2C_WRITE 0
+#define BB_I2C_READ  1
+
+// status of a queued transaction
+#define BB_I2C_STATUS_PENDING 0   // waiting in the queue
+#define BB_I2C_STATUS_BUSY    1   // currently transferred
+#define BB_I2C_STATUS_DONE    2   // finished successfully
+#define BB_I2C_STATUS_ERROR   3   // finished with an error (NACK, bus error)
+#define BB_I2C_STATUS_TIMEOUT 4   // aborted, the bus did not respond in time
+
+/**
+ * Describes one transaction processed in the background by the interrupt
+ * driven TWI engine. The descriptor and the data buffer are owned by the
+ * caller and have to stay valid until the transaction has finished.
+ */
+struct BB_I2C_TRANSACTION{
+	uint8_t devAddr;            // the I2C address of the slave
+	uint8_t regAddr;            // the address of the first register on the slave
+	uint8_t *data;              // data to be written / buffer for the data read
+	uint8_t len;                // number of bytes to be transferred (> 0)
+	uint8_t direction;          // BB_I2C_READ or BB_I2C_WRITE
+	volatile uint8_t status;    // BB_I2C_STATUS_X, updated by the engine
+	void (*callback)(BB_I2C_TRANSACTION *transaction); // called from the ISR when finished, may be 0
+};
+
+/**
+ * Counts the errors seen on the I2C bus (blocking and interrupt driven transfers).
+ */
+struct BB_I2C_ERRORS{
+	uint16_t nack;              // slave address or data not acknowledged
+	uint16_t arbitrationLost;   // arbitration lost against another master
+	uint16_t busError;          // illegal START / STOP condition
+	uint16_t timeout;           // the bus did not respond within BB_I2C_TIMEOUT_US
+	uint16_t failed;            // transactions given up (retry budget exhausted, fatal error)
+	uint16_t recoveries;        // bus clear sequences performed
+};
 
 /**
  * Objects of this class are used for communication using the I2C protocol.
  * This is for a I2C master. This class provides the methods to read /
- * write one value into / from a register of a I2C slave.
+ * write one value or a block of consecutive values into / from the registers
+ * of a I2C slave.
  */
 class BB_I2C{
 
 	public:
 	    /**
 	     * Initiates a new I2C object.
+	     * @param sclClock the SCL clock in Hz, e.g. BB_I2C_FAST_MODE. 0 selects SCL_CLOCK.
 	     */
-	    BB_I2C();
+	    BB_I2C(uint32_t sclClock = SCL_CLOCK);
 	    //int8_t init(); //TODO remove
 
+	    /**
+	     * Sets the SCL clock. Bit rate (TWBR) and prescaler are chosen so the
+	     * clock does not exceed neither sclClock nor the maximum clock of a
+	     * slave registered with setDeviceClock(). Clocks above F_CPU / 16 are
+	     * limited to F_CPU / 16.
+	     * @param sclClock the SCL clock in Hz, e.g. BB_I2C_FAST_MODE
+	     * @return 1 if the clock can be generated, -1 if it is 0 or too low for F_CPU
+	     */
+	    int8_t setClock(uint32_t sclClock);
+
+	    /**
+	     * Provides the SCL clock which is actually generated.
+	     * @return the SCL clock in Hz
+	     */
+	    uint32_t getClock(void);
+
+	    /**
+	     * Registers the maximum SCL clock tolerated by one slave. The bus is
+	     * run at the fastest clock all registered slaves tolerate.
+	     * @param dev_addr the I2C address of the slave
+	     * @param maxSclClock the maximum SCL clock of the slave in Hz
+	     * @return 1 if successful, -1 if maxSclClock is 0, too low for F_CPU or
+	     *         BB_I2C_MAX_DEVICES slaves are registered already
+	     */
+	    int8_t setDeviceClock(uint8_t dev_addr, uint32_t maxSclClock);
+
 	    /**
 	     * Read one byte of data from a register of one I2C slave.
 	     * @param reg_address the address of the register on the I2C slave
@@ -60,7 +172,128 @@ class BB_I2C{
 	     */
 	    int8_t writebyte(uint8_t reg_address, uint8_t dev_addr, uint8_t data);
 
+	    /**
+	     * Reads a block of consecutive registers of one I2C slave within one
+	     * transaction. The slave has to support register address auto-increment.
+	     * All bytes but the last one are acknowledged by the master.
+	     * @param reg_address the address of the first register on the I2C slave
+	     * @param dev_addr the I2C address of the slave
+	     * @param data contains the data after I2C communication (at least len bytes)
+	     * @param len the number of registers to be read. Has to be > 0.
+	     * @return 1 if I2C communication was successful
+	     */
+	    int8_t readBlock(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len);
+
+	    /**
+	     * Writes a block of data into consecutive registers of one I2C slave
+	     * within one transaction. The slave has to support register address
+	     * auto-increment.
+	     * @param reg_address the address of the first register on the I2C slave
+	     * @param dev_addr the I2C address of the slave
+	     * @param data the data which will be written to the slave (len bytes)
+	     * @param len the number of registers to be written. Has to be > 0.
+	     * @return 1 if I2C communication was successful
+	     */
+	    int8_t writeBlock(uint8_t reg_address, uint8_t dev_addr, const uint8_t* data, uint8_t len);
+
+	    /**
+	     * Queues a burst read which is processed in the background by the
+	     * interrupt driven TWI engine (ISR(TWI_vect)). The method returns at once.
+	     * Global interrupts have to be enabled. Timer2 is used to abort a
+	     * transaction if the bus does not respond within BB_I2C_TIMEOUT_US.
+	     * @param reg_address the address of the first register on the I2C slave
+	     * @param dev_addr the I2C address of the slave
+	     * @param data buffer for the data (at least len bytes), valid until the transaction finished
+	     * @param len the number of registers to be read. Has to be > 0.
+	     * @param transaction the descriptor of the transaction, valid until the transaction finished
+	     * @param callback called from the ISR when the transaction finished, may be 0
+	     * @return 1 if the transaction was queued, -1 if the queue is full
+	     */
+	    int8_t readBlockAsync(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len,
+	                          BB_I2C_TRANSACTION *transaction,
+	                          void (*callback)(BB_I2C_TRANSACTION *transaction) = 0);
+
+	    /**
+	     * Queues a burst write which is processed in the background by the
+	     * interrupt driven TWI engine (ISR(TWI_vect)). The method returns at once.
+	     * Global interrupts have to be enabled. Timer2 is used to abort a
+	     * transaction if the bus does not respond within BB_I2C_TIMEOUT_US.
+	     * @param reg_address the address of the first register on the I2C slave
+	     * @param dev_addr the I2C address of the slave
+	     * @param data the data to be written (len bytes), valid until the transaction finished
+	     * @param len the number of registers to be written. Has to be > 0.
+	     * @param transaction the descriptor of the transaction, valid until the transaction finished
+	     * @param callback called from the ISR when the transaction finished, may be 0
+	     * @return 1 if the transaction was queued, -1 if the queue is full
+	     */
+	    int8_t writeBlockAsync(uint8_t reg_address, uint8_t dev_addr, uint8_t* data, uint8_t len,
+	                           BB_I2C_TRANSACTION *transaction,
+	                           void (*callback)(BB_I2C_TRANSACTION *transaction) = 0);
+
+	    /**
+	     * Queues a transaction for the interrupt driven TWI engine. All fields
+	     * except status have to be set by the caller.
+	     * @param transaction the descriptor of the transaction
+	     * @return 1 if the transaction was queued, -1 if the queue is full
+	     */
+	    int8_t queue(BB_I2C_TRANSACTION *transaction);
+
+	    /**
+	     * Waits until a queued transaction has finished. The controller is set
+	     * to idle sleep mode while waiting, any interrupt (TWI, SPI, ...) wakes it up.
+	     * The interrupts are enabled while sleeping, the state of the caller is
+	     * restored on return. Must not be called from an ISR or a transaction callback.
+	     * @param transaction the descriptor of the transaction
+	     * @return 1 if the transaction was successful, -1 otherwise
+	     */
+	    int8_t wait(BB_I2C_TRANSACTION *transaction);
+
+	    /**
+	     * Checks whether the interrupt driven engine is processing transactions.
+	     * @return 1 if there are queued transactions, 0 otherwise
+	     */
+	    uint8_t isBusy(void);
+
+	    /**
+	     * Frees a blocked bus: clocks SCL up to 9 times until a slave stuck in
+	     * the middle of a byte releases SDA, then generates a STOP condition.
+	     * Called automatically after a timeout or a bus error.
+	     * @return 1 if SDA and SCL are released afterwards, -1 otherwise
+	     */
+	    int8_t recoverBus(void);
+
+	    /**
+	     * Provides the error counters.
+	     * @param errors contains the error counters after the call
+	     */
+	    void getErrors(BB_I2C_ERRORS *errors);
+
+	    /**
+	     * Resets all error counters to 0.
+	     */
+	    void clearErrors(void);
+
 	private:
+	    /**
+	     * The SCL clock requested by the user.
+	     */
+	    uint32_t _sclClock;
+
+	    /**
+	     * The I2C addresses of the slaves registered with setDeviceClock().
+	     */
+	    uint8_t _deviceAddr[BB_I2C_MAX_DEVICES];
+
+	    /**
+	     * The maximum SCL clocks of the slaves registered with setDeviceClock().
+	     */
+	    uint32_t _deviceClock[BB_I2C_MAX_DEVICES];
+
+	    /**
+	     * The number of slaves registered with setDeviceClock().
+	     */
+	    uint8_t _deviceCount;
+
 	    /**
 	     * Initiates the I2C settings.
 	     * @return
@@ -68,11 +301,40 @@ class BB_I2C{
 	    int8_t _init();
 
 	    /**
-	     * Controls the data transmission
-	     * @param type one I2C condition (Start, send, stop)
+	     * Writes bit rate and prescaler for the slowest of the requested
+	     * clock and the maximum clocks of all registered slaves.
+	     * @return 1 if the clock can be generated, -1 otherwise
+	     */
+	    int8_t _applyClock(void);
+
+	    /**
+	     * Controls the data transmission. Waits at most BB_I2C_TIMEOUT_US for the TWI.
+	     * @param type one I2C condition (Start, send, send with ACK, stop)
 	     * @return return TWI Status Register without the prescaler bits (TWPS1,TWPS0)
+	     *         or I2C_TIMEOUT
 	     */
 	    uint8_t _transmit(uint8_t type);
+
+	    /**
+	     * Waits until the interrupt driven engine has finished all queued
+	     * transactions, so the blocking methods can use the TWI exclusively.
+	     */
+	    void _waitIdle(void);
+
+	    /**
+	     * Counts a failed bus step and decides if the transaction is repeated.
+	     * @param twi_status the TWI status of the failed step
+	     * @param attempts the number of attempts so far, incremented by the call
+	     * @return 1 if the transaction should be repeated
+	     */
+	    uint8_t _retry(uint8_t twi_status, uint8_t *attempts);
+
+	    /**
+	     * Counts the final error of a failed transaction and clears the bus
+	     * after a timeout or a bus error.
+	     * @param twi_status the TWI status of the failed step
+	     */
+	    void _fail(uint8_t twi_status);
 };
 
 #endif /* BB_I2C_H_ */
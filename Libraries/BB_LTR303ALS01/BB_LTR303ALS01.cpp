@@ -8,10 +8,67 @@
 
 #include "BB_LTR303ALS01.h"
 
+// gain, integration time and measurement rate of the ranges
+// (the measurement rate has to be >= the integration time)
+static const uint8_t _ranges[LTR303ALS01_RANGES][3] = {
+	{LTR303ALS01_GAIN_1X,  LTR303ALS01_INT_50ms,  LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_1X,  LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_2X,  LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_4X,  LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_8X,  LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_48X, LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_96X, LTR303ALS01_INT_100ms, LTR303ALS01_MEAS_100ms},
+	{LTR303ALS01_GAIN_96X, LTR303ALS01_INT_200ms, LTR303ALS01_MEAS_200ms},
+	{LTR303ALS01_GAIN_96X, LTR303ALS01_INT_400ms, LTR303ALS01_MEAS_500ms},
+};
+
+// gain factor of LTR303ALS01_GAIN_X
+static const uint8_t _gainFactor[8] = {1, 2, 4, 8, 1, 1, 48, 96};
+
+// integration time in ms of LTR303ALS01_INT_X
+static const uint16_t _integrationMs[8] = {100, 50, 200, 400, 150, 250, 300, 350};
+
+/**
+ * Finds the range with the sensitivity closest to a gain and an integration time.
+ * @param gain LTR303ALS01_GAIN_X
+ * @param integrationTime LTR303ALS01_INT_X
+ * @return LTR303ALS01_RANGE_X
+ */
+static uint8_t _nearestRange(uint8_t gain, uint8_t integrationTime){
+	uint32_t sensitivity = (uint32_t) _gainFactor[gain & 0x07] * _integrationMs[integrationTime & 0x07];
+	uint32_t rangeSensitivity, difference;
+	uint32_t best = 0xFFFFFFFF;
+	uint8_t range = 0;
+
+	for (uint8_t i = 0; i < LTR303ALS01_RANGES; i++){
+		rangeSensitivity = (uint32_t) _gainFactor[_ranges[i][0]] * _integrationMs[_ranges[i][1]];
+		difference = (rangeSensitivity > sensitivity) ? rangeSensitivity - sensitivity : sensitivity - rangeSensitivity;
+		if (difference < best){
+			best = difference;
+			range = i;
+		}
+	}
+	return range;
+}
+
+// the registers of the shadow, LTR303ALS01_SHADOW_X
+#define LTR303ALS01_SHADOW_CONTR 0
+#define LTR303ALS01_SHADOW_MEAS_RATE 1
+#define LTR303ALS01_SHADOW_INTERRUPT 2
+#define LTR303ALS01_SHADOW_THRES_UP_0 3  // .. ALS_THRES_LOW_1 at 6
+#define LTR303ALS01_SHADOW_PERSIST 7
+
+static const uint8_t _shadowRegister[LTR303ALS01_SHADOW_SIZE] = {
+	ALS_CONTR, ALS_MEAS_RATE, INTERRUPT,
+	ALS_THRES_UP_0, ALS_THRES_UP_1, ALS_THRES_LOW_0, ALS_THRES_LOW_1,
+	INTERRUPT_PERSIST
+};
+
 // public:
 BB_LTR303ALS01::BB_LTR303ALS01(BB_I2C *i2c){
 	this->_i2c = i2c;
     this->_i2cAddr = BB_LTR303ALS01_ADDRESS;
+    this->_i2c->setDeviceClock(this->_i2cAddr, BB_LTR303ALS01_MAX_SCL_CLOCK);
     this->_settings = {
     		LTR303ALS01_GAIN_8X,
     		LTR303ALS01_MODE_ACTIVE,
@@ -25,9 +82,19 @@ BB_LTR303ALS01::BB_LTR303ALS01(BB_I2C *i2c){
     		0x00,
     		0
     };
+    this->_range = LTR303ALS01_RANGE_8X_100ms;
+    this->_dataGain = this->_settings.gain;
+    this->_dataIntegrationTime = this->_settings.integrationTime;
+    this->_rangePending = 0;
+    this->_autoRange = 1;
+
+    // the content of the registers is unknown -> write all of them once
+    for (uint8_t i = 0; i < LTR303ALS01_SHADOW_SIZE; i++) this->_shadow[i] = 0;
+    this->_dirty = 0xFF;
+    this->_composeSettings();
 
     _delay_ms(100);  // see application note
-    this->_writeSettings2Sensor();
+    this->commit();
 }
 
 uint8_t BB_LTR303ALS01::readManufacturerId(void){
@@ -35,79 +102,237 @@ uint8_t BB_LTR303ALS01::readManufacturerId(void){
 }
 
 uint16_t BB_LTR303ALS01::readChannel1(void){
-	uint16_t ch0 = 0x00; // visible   (peak @ 450nm)
-	uint16_t ch1 = 0x00; // infra-red (peak @ 770nm)
-	uint8_t msb0, lsb0, msb1, lsb1;
+	uint16_t ch0 = 0x00;
+	uint16_t ch1 = 0x00;
+	this->readChannels(ch0, ch1);
+	return ch1;
+}
 
-	//TODO implement a check if the data is valid
-	//_readStatus();
+uint16_t BB_LTR303ALS01::readChannel0(void){
+	uint16_t ch0 = 0x00;
+	uint16_t ch1 = 0x00;
+	this->readChannels(ch0, ch1);
+	return ch0;
+}
 
-	// read always both data registers as a block (see application note)
-	// TODO check if this is really necessary
-	lsb1 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH1_0);
-	msb1 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH1_1);
+int8_t BB_LTR303ALS01::readChannels(uint16_t &ch0, uint16_t &ch1){
+	BB_LTR303ALS01_STATUS status;
+	uint8_t data[4];
+	BB_I2C_TRANSACTION transaction;
 
-	lsb0 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH0_0);
-	msb0 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH0_1);
+	// the data status is reset by reading the data -> read the status first
+	if (this->readStatus(status) != 1) return -1;
+	if (status.dataValid) return -1;
 
-	ch1 = (uint16_t) (((uint16_t) msb1 << 8) | lsb1);
-	ch0 = (uint16_t) (((uint16_t) msb0 << 8) | lsb0);
+	// read always both data registers as a block (see application note), the
+	// sensor locks the data registers during the burst read. The interrupt
+	// driven engine transfers it, the controller sleeps meanwhile.
+	if (this->_i2c->readBlockAsync(ALS_DATA_CH1_0, this->_i2cAddr, data, sizeof(data), &transaction) != 1) return -1;
+	if (this->_i2c->wait(&transaction) != 1) return -1;
 
+	ch1 = (uint16_t) (((uint16_t) data[1] << 8) | data[0]);
+	ch0 = (uint16_t) (((uint16_t) data[3] << 8) | data[2]);
 
-	return ch1;
+	return status.dataStatus ? 1 : 0;
 }
 
-uint16_t BB_LTR303ALS01::readChannel0(void){
-	uint16_t ch0 = 0x00; // visible   (peak @ 450nm)
-	uint16_t ch1 = 0x00; // infra-red (peak @ 770nm)
-	uint8_t msb0, lsb0, msb1, lsb1;
+int8_t BB_LTR303ALS01::readStatus(BB_LTR303ALS01_STATUS &status){
+	uint8_t value;
+	if (this->_i2c->readbyte(ALS_STATUS, this->_i2cAddr, &value) != 1) return -1;
+	status.dataValid = (value >> 7) & 0x01;
+	status.dataGainRange = (value >> 4) & 0x07;
+	status.interruptStatus = (value >> 3) & 0x01;
+	status.dataStatus = (value >> 2) & 0x01;
+	return 1;
+}
 
-	//TODO implement a check if the data is valid
-	//_readStatus();
+int8_t BB_LTR303ALS01::readLux(uint32_t &lux){
+	BB_LTR303ALS01_STATUS status;
+	uint16_t ch0, ch1, counts;
+	int8_t r_val;
+	uint8_t range;
 
-	// read always both data registers as a block (see application note)
-	// TODO check if this is really necessary
-	lsb1 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH1_0);
-	msb1 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH1_1);
+	if (this->_rangePending > 0){
+		// wait for data of the new range
+		if (this->readStatus(status) != 1) return -1;
+		if (!status.dataStatus) return 0;
+		if (--this->_rangePending > 0){
+			// the first new data may be from a cycle started before the change
+			if (this->readChannels(ch0, ch1) < 0) return -1;
+			return 0;
+		}
+		this->_dataGain = this->_settings.gain;
+		this->_dataIntegrationTime = this->_settings.integrationTime;
+	}
 
-	lsb0 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH0_0);
-	msb0 = this->_i2cRead((BB_LTR303ALS01_REGISTER) ALS_DATA_CH0_1);
+	r_val = this->readChannels(ch0, ch1);
+	if ((r_val < 0) && (this->readStatus(status) != 1)) return -1;
 
-	ch1 = (uint16_t) (((uint16_t) msb1 << 8) | lsb1);
-	ch0 = (uint16_t) (((uint16_t) msb0 << 8) | lsb0);
+	range = this->_range;
+	if ((r_val < 0) || (ch0 >= LTR303ALS01_RANGE_HIGH) || (ch1 >= LTR303ALS01_RANGE_HIGH)){
+		// saturated or invalid -> less sensitive
+		if (range > 0) range--;
+	} else {
+		counts = (ch0 > ch1) ? ch0 : ch1;
+		if ((counts < LTR303ALS01_RANGE_LOW) && (range < LTR303ALS01_RANGES - 1)) range++;
+	}
 
+	if (r_val >= 0){
+		// the data belongs to the settings of its measurement
+		lux = calculateLux(ch0, ch1, this->_dataGain, this->_dataIntegrationTime);
+	}
 
-	return ch0;
+	if (this->_autoRange && (range != this->_range)){
+		if (this->setRange(range) != 1) return -1;
+	}
 
+	if (r_val < 0){
+		// invalid data but I2C communication was successful -> try again
+		if (!this->_autoRange || (this->_rangePending == 0)) return -1;
+		return 0;
+	}
+	return 1;
 }
 
-// private:
-void BB_LTR303ALS01::_writeSettings2Sensor(void){
+uint32_t BB_LTR303ALS01::calculateLux(uint16_t ch0, uint16_t ch1, uint8_t gain, uint8_t integrationTime){
+	// lux = (c0 * ch0 + c1 * ch1) / gain / (integration time / 100ms), with the
+	// coefficients scaled by 10000 the result in 0.01 lx is
+	// (c0 * ch0 + c1 * ch1) / (gain * integration time in ms)
+	uint32_t sum = (uint32_t) ch0 + ch1;
+	uint32_t num;
+
+	if (sum == 0) return 0;
+	if ((uint32_t) ch1 * 100 < sum * 45){
+		num = 17743UL * ch0 + 11059UL * ch1;
+	} else if ((uint32_t) ch1 * 100 < sum * 64){
+		num = 42785UL * ch0 - 19548UL * ch1;
+	} else if ((uint32_t) ch1 * 100 < sum * 85){
+		num = 5926UL * ch0 + 1185UL * ch1;
+	} else {
+		return 0;
+	}
+	return num / ((uint32_t) _gainFactor[gain & 0x07] * _integrationMs[integrationTime & 0x07]);
+}
+
+int8_t BB_LTR303ALS01::setRange(uint8_t range){
+	if (range >= LTR303ALS01_RANGES) return -1;
+
+	this->_settings.gain = _ranges[range][0];
+	this->_settings.integrationTime = _ranges[range][1];
+	this->_settings.measurementRate = _ranges[range][2];
+	this->_composeSettings();
+	if (this->commit() != 1) return -1;
 
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) ALS_CONTR, 0x00, 0x07, 5 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) ALS_CONTR, this->_settings.gain, 0x07, 2 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) ALS_CONTR, this->_settings.mode, 0x01, 0 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) ALS_MEAS_RATE, this->_settings.integrationTime, 0x07, 3 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) ALS_MEAS_RATE, this->_settings.measurementRate, 0x07, 0 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) INTERRUPT, this->_settings.interruptPolarity, 0x01, 2 );
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) INTERRUPT, this->_settings.interruptMode, 0x01, 1 );
+	this->_range = range;
+	this->_rangePending = 2;
+	return 1;
+}
+
+uint8_t BB_LTR303ALS01::getRange(void){
+	return this->_range;
+}
+
+void BB_LTR303ALS01::setAutoRange(uint8_t enabled){
+	this->_autoRange = enabled;
+}
+
+int8_t BB_LTR303ALS01::setThresholds(uint16_t low, uint16_t up){
+	this->_settings.thresholdUp0 = (uint8_t) up;
+	this->_settings.thresholdUp1 = (uint8_t) (up >> 8);
+	this->_settings.thresholdLow0 = (uint8_t) low;
+	this->_settings.thresholdLow1 = (uint8_t) (low >> 8);
+	this->_composeSettings();
+	return this->commit();
+}
+
+int8_t BB_LTR303ALS01::setInterruptPersist(uint8_t persist){
+	this->_settings.interruptPersist = (persist > 0x0F) ? 0x0F : persist;
+	this->_composeSettings();
+	return this->commit();
+}
 
-	this->_i2cWrite((BB_LTR303ALS01_REGISTER) ALS_THRES_UP_0, this->_settings.thresholdUp0);
-	this->_i2cWrite((BB_LTR303ALS01_REGISTER) ALS_THRES_UP_1, this->_settings.thresholdUp1);
-	this->_i2cWrite((BB_LTR303ALS01_REGISTER) ALS_THRES_LOW_0, this->_settings.thresholdLow0);
-	this->_i2cWrite((BB_LTR303ALS01_REGISTER) ALS_THRES_LOW_1, this->_settings.thresholdLow1);
+int8_t BB_LTR303ALS01::setInterrupt(uint8_t mode, uint8_t polarity){
+	this->_settings.interruptMode = mode;
+	this->_settings.interruptPolarity = polarity;
+	this->_composeSettings();
+	return this->commit();
+}
+
+int8_t BB_LTR303ALS01::setSettings(const BB_LTR303ALS01_SETTINGS &settings){
+	uint8_t changed = (settings.gain != this->_settings.gain) ||
+	                  (settings.integrationTime != this->_settings.integrationTime);
 
-	this->_writeRegister((BB_LTR303ALS01_REGISTER) INTERRUPT_PERSIST, this->_settings.interruptMode, 0x0F, 0 );
+	this->_settings = settings;
+	this->_composeSettings();
+	if (changed){
+		// the shadow reaches the sensor with this commit or the next one,
+		// the data of the new settings follows as after setRange()
+		this->_range = _nearestRange(settings.gain, settings.integrationTime);
+		this->_rangePending = 2;
+	}
+	return this->commit();
 }
 
-void BB_LTR303ALS01::_writeRegister (BB_LTR303ALS01_REGISTER regAddr, uint8_t val, uint8_t mask, uint8_t shift){
-	uint8_t data;
+int8_t BB_LTR303ALS01::commit(void){
+	int8_t r_val = 1;
+
+	if (!this->_dirty) return 1;
 
-	data = this->_i2cRead(regAddr);
+	// the interrupt register may only be written in stand-by (see datasheet),
+	// the mode is restored by writing ALS_CONTR last
+	if ((this->_dirty & (1 << LTR303ALS01_SHADOW_INTERRUPT)) &&
+	    (this->_shadow[LTR303ALS01_SHADOW_CONTR] & 0x01)){
+		if (this->_i2c->writebyte(ALS_CONTR, this->_i2cAddr,
+		                          this->_shadow[LTR303ALS01_SHADOW_CONTR] & ~0x01) != 1) return -1;
+		this->_dirty |= (1 << LTR303ALS01_SHADOW_CONTR);
+	}
 
-	data = (data & ~(mask << shift)) | ((val << shift) & (val << shift));
+	if (this->_commitRegister(LTR303ALS01_SHADOW_MEAS_RATE) != 1) r_val = -1;
+	if (this->_commitRegister(LTR303ALS01_SHADOW_INTERRUPT) != 1) r_val = -1;
 
-	this->_i2cWrite(regAddr, data);
+	// the four thresholds in one burst write
+	if (this->_dirty & (0x0F << LTR303ALS01_SHADOW_THRES_UP_0)){
+		if (this->_i2c->writeBlock(ALS_THRES_UP_0, this->_i2cAddr,
+		                           &this->_shadow[LTR303ALS01_SHADOW_THRES_UP_0], 4) == 1){
+			this->_dirty &= ~(0x0F << LTR303ALS01_SHADOW_THRES_UP_0);
+		} else {
+			r_val = -1;
+		}
+	}
+
+	if (this->_commitRegister(LTR303ALS01_SHADOW_PERSIST) != 1) r_val = -1;
+	if (this->_commitRegister(LTR303ALS01_SHADOW_CONTR) != 1) r_val = -1;
+
+	return r_val;
+}
+
+// private:
+void BB_LTR303ALS01::_composeSettings(void){
+	this->_setRegister(LTR303ALS01_SHADOW_CONTR,
+	                   (uint8_t) (((this->_settings.gain & 0x07) << 2) | (this->_settings.mode & 0x01)));
+	this->_setRegister(LTR303ALS01_SHADOW_MEAS_RATE,
+	                   (uint8_t) (((this->_settings.integrationTime & 0x07) << 3) | (this->_settings.measurementRate & 0x07)));
+	this->_setRegister(LTR303ALS01_SHADOW_INTERRUPT,
+	                   (uint8_t) (((this->_settings.interruptPolarity & 0x01) << 2) | ((this->_settings.interruptMode & 0x01) << 1)));
+	this->_setRegister(LTR303ALS01_SHADOW_THRES_UP_0, this->_settings.thresholdUp0);
+	this->_setRegister(LTR303ALS01_SHADOW_THRES_UP_0 + 1, this->_settings.thresholdUp1);
+	this->_setRegister(LTR303ALS01_SHADOW_THRES_UP_0 + 2, this->_settings.thresholdLow0);
+	this->_setRegister(LTR303ALS01_SHADOW_THRES_UP_0 + 3, this->_settings.thresholdLow1);
+	this->_setRegister(LTR303ALS01_SHADOW_PERSIST, (uint8_t) (this->_settings.interruptPersist & 0x0F));
+}
+
+void BB_LTR303ALS01::_setRegister(uint8_t index, uint8_t value){
+	if (this->_shadow[index] != value){
+		this->_shadow[index] = value;
+		this->_dirty |= (1 << index);
+	}
+}
+
+int8_t BB_LTR303ALS01::_commitRegister(uint8_t index){
+	if (!(this->_dirty & (1 << index))) return 1;
+	if (this->_i2c->writebyte(_shadowRegister[index], this->_i2cAddr, this->_shadow[index]) != 1) return -1;
+	this->_dirty &= ~(1 << index);
+	return 1;
 }
 
 uint8_t BB_LTR303ALS01::_i2cRead(BB_LTR303ALS01_REGISTER registerAddr){
@@ -115,8 +340,3 @@ uint8_t BB_LTR303ALS01::_i2cRead(BB_LTR303ALS01_REGISTER registerAddr){
   this->_i2c->readbyte(registerAddr, this->_i2cAddr, &value);
   return value;
 }
-
-void BB_LTR303ALS01::_i2cWrite(BB_LTR303ALS01_REGISTER registerAddr, uint8_t value){
-	this->_i2c->writebyte(registerAddr, this->_i2cAddr, value);
-}
-
@@ -21,6 +21,9 @@ extern "C" {
 // The I2C address of the sensor
 #define BB_LTR303ALS01_ADDRESS (0x29)
 
+// The fastest SCL clock of the sensor
+#define BB_LTR303ALS01_MAX_SCL_CLOCK BB_I2C_FAST_MODE
+
 // light integration time settings
 #define LTR303ALS01_INT_100ms 0
 #define LTR303ALS01_INT_50ms  1
@@ -47,6 +50,26 @@ extern "C" {
 #define LTR303ALS01_GAIN_48X 6
 #define LTR303ALS01_GAIN_96X 7
 
+// ranges of the automatic ranging (gain and integration time), from the
+// least to the most sensitive one
+#define LTR303ALS01_RANGE_1X_50ms   0
+#define LTR303ALS01_RANGE_1X_100ms  1
+#define LTR303ALS01_RANGE_2X_100ms  2
+#define LTR303ALS01_RANGE_4X_100ms  3
+#define LTR303ALS01_RANGE_8X_100ms  4
+#define LTR303ALS01_RANGE_48X_100ms 5
+#define LTR303ALS01_RANGE_96X_100ms 6
+#define LTR303ALS01_RANGE_96X_200ms 7
+#define LTR303ALS01_RANGE_96X_400ms 8
+#define LTR303ALS01_RANGES 9
+
+// the automatic ranging keeps the larger channel between these counts
+#define LTR303ALS01_RANGE_HIGH 0xE000
+#define LTR303ALS01_RANGE_LOW  0x1C00
+
+// number of writable registers kept in the shadow of the driver
+#define LTR303ALS01_SHADOW_SIZE 8
+
 // Reset w/ or w/o running the start-up procedure
 #define LTR303ALS01_RESET_WITHOUT_STARTUP 0
 #define LTR303ALS01_RESET_WITH_STARTUP    1
@@ -80,15 +103,15 @@ struct BB_LTR303ALS01_SETTINGS{
 	uint8_t interruptPersist;	// number of occurrences until interrupt is asserted
 };
 
-//TODO future implementations
-/*
+/**
+ * Contains the status of the LTR303ALS01 (register ALS_STATUS)
+ */
 struct BB_LTR303ALS01_STATUS{
 	uint8_t dataValid;        // 0 : data is valid, 1 : data is invalid
 	uint8_t dataGainRange;    // LTR303ALS01_GAIN_X
 	uint8_t interruptStatus;  // 0 : interrupt signal inactive, 1 : interrupt signal active
 	uint8_t dataStatus;       // 0 : old data, 1 : new data available
 };
-*/
 
 //REGISTER ADDRESSES
 enum BB_LTR303ALS01_REGISTER{
@@ -145,7 +168,115 @@ class BB_LTR303ALS01{
 	     */
 		uint16_t readChannel1(void);
 
-		//TODO implement methods for changing the settings
+	    /**
+	     * Provides the values of both channels from the same integration cycle.
+	     * The status is checked first, then the data registers are read with one
+	     * burst read (CH1 low, CH1 high, CH0 low, CH0 high - see application note).
+	     * The burst read is done by the interrupt driven engine of BB_I2C, the
+	     * controller sleeps (idle) meanwhile. Must not be called from an ISR.
+	     * @param ch0 the value of channel 0 (visible + infra-red)
+	     * @param ch1 the value of channel 1 (infra-red)
+	     * @return 1 if new data was read, 0 if the data was read before (still a
+	     * coherent pair), -1 if I2C communication failed or the data is invalid
+	     */
+		int8_t readChannels(uint16_t &ch0, uint16_t &ch1);
+
+	    /**
+	     * Reads the status of the sensor.
+	     * @param status contains the status after the call
+	     * @return 1 if I2C communication was successful
+	     */
+		int8_t readStatus(BB_LTR303ALS01_STATUS &status);
+
+	    /**
+	     * Provides the illuminance. The lux value is calculated from both channels
+	     * (see calculateLux()). If automatic ranging is enabled, gain and integration
+	     * time are adjusted afterwards to keep the counts between LTR303ALS01_RANGE_LOW
+	     * and LTR303ALS01_RANGE_HIGH. After a change the sensor needs up to two
+	     * measurement periods until the data belongs to the new range.
+	     * @param lux the illuminance in 0.01 lx
+	     * @return 1 if lux is valid, 0 if the range is being changed (call again later),
+	     * -1 if I2C communication failed
+	     */
+		int8_t readLux(uint32_t &lux);
+
+	    /**
+	     * Calculates the illuminance following the application note of the LTR303ALS01
+	     * (coefficients depending on the ratio CH1 / (CH0 + CH1), normalized by gain
+	     * and integration time). Fixed point, no floats.
+	     * @param ch0 the value of channel 0
+	     * @param ch1 the value of channel 1
+	     * @param gain the gain during the measurement, LTR303ALS01_GAIN_X
+	     * @param integrationTime the integration time during the measurement, LTR303ALS01_INT_X
+	     * @return the illuminance in 0.01 lx
+	     */
+		static uint32_t calculateLux(uint16_t ch0, uint16_t ch1, uint8_t gain, uint8_t integrationTime);
+
+	    /**
+	     * Sets gain, integration time and measurement rate.
+	     * @param range LTR303ALS01_RANGE_X
+	     * @return 1 if successful, -1 for an invalid range
+	     */
+		int8_t setRange(uint8_t range);
+
+	    /**
+	     * Provides the current range.
+	     * @return LTR303ALS01_RANGE_X
+	     */
+		uint8_t getRange(void);
+
+	    /**
+	     * Enables or disables the automatic ranging of readLux() (enabled by default).
+	     * @param enabled 1 to enable, 0 to disable
+	     */
+		void setAutoRange(uint8_t enabled);
+
+	    /**
+	     * Sets the thresholds of the interrupt. The interrupt is asserted when the
+	     * value of channel 0 is above up or below low. The values are counts in
+	     * the current range.
+	     * @param low the lower threshold
+	     * @param up the upper threshold
+	     * @return 1 if I2C communication was successful
+	     */
+		int8_t setThresholds(uint16_t low, uint16_t up);
+
+	    /**
+	     * Sets the number of consecutive values out of the thresholds until the
+	     * interrupt is asserted.
+	     * @param persist 0: every value, n: n + 1 consecutive values (up to 15)
+	     * @return 1 if I2C communication was successful
+	     */
+		int8_t setInterruptPersist(uint8_t persist);
+
+	    /**
+	     * Enables or disables the interrupt. The sensor is set to stand-by while
+	     * the interrupt register is written (see datasheet). The INT pin stays
+	     * asserted until the data is read (readChannels(), readLux()).
+	     * @param mode LTR303ALS01_INTERRUPT_X
+	     * @param polarity LTR303ALS01_INTERRUPT_ACTIVE_X
+	     * @return 1 if I2C communication was successful
+	     */
+		int8_t setInterrupt(uint8_t mode, uint8_t polarity);
+
+	    /**
+	     * Changes all settings at once. Each register is written once at most.
+	     * A new gain or integration time selects the range with the closest
+	     * sensitivity for the automatic ranging. readLux() calculates with the
+	     * gain and integration time of the settings.
+	     * @param settings the new settings
+	     * @return 1 if I2C communication was successful
+	     */
+		int8_t setSettings(const BB_LTR303ALS01_SETTINGS &settings);
+
+	    /**
+	     * Writes the registers changed since the last commit to the sensor.
+	     * The settings are composed in a shadow of the registers, so no register
+	     * has to be read before it is written. The set methods commit themselves.
+	     * @return 1 if I2C communication was successful, the failed registers
+	     * are written again by the next commit
+	     */
+		int8_t commit(void);
 
     private:
 		/**
@@ -162,7 +293,24 @@ class BB_LTR303ALS01{
 	     * Contains the current settings of the LTR303ALS01.
 	     */
 	    struct BB_LTR303ALS01_SETTINGS _settings;
-	    //struct BB_LTR303ALS01_STATUS _status;
+
+	    /**
+	     * The current range, gain and integration time of the data in the data
+	     * registers and the number of new data cycles until the data belongs
+	     * to the current settings.
+	     */
+	    uint8_t _range;
+	    uint8_t _dataGain;
+	    uint8_t _dataIntegrationTime;
+	    uint8_t _rangePending;
+	    uint8_t _autoRange;
+
+	    /**
+	     * The shadow of the writable registers and one bit per register which
+	     * differs from the sensor (LTR303ALS01_SHADOW_X).
+	     */
+	    uint8_t _shadow[LTR303ALS01_SHADOW_SIZE];
+	    uint8_t _dirty;
 
 	    /**
 	     * A convenience method used to perform a read operation on the I2C bus.
@@ -173,28 +321,23 @@ class BB_LTR303ALS01{
 	    uint8_t _i2cRead(BB_LTR303ALS01_REGISTER regAddr);
 
 	    /**
-	     * A convenience method used to perform a write operation on the I2C bus.
-	     * This method pushes a value into one register of the BME280.
-	     * @param reg a register address on the BME280
-	     * @param value new data for the BME280 register
+	     * Composes the shadow registers from the settings.
 	     */
-	    void _i2cWrite(BB_LTR303ALS01_REGISTER regAddr, uint8_t value);
+	    void _composeSettings(void);
 
 	    /**
-	     * Writes the settings to the sensor.
+	     * Sets a shadow register, marks it dirty if the value changes.
+	     * @param index LTR303ALS01_SHADOW_X
+	     * @param value the new value of the register
 	     */
-	    void _writeSettings2Sensor(void);
+	    void _setRegister(uint8_t index, uint8_t value);
 
 	    /**
-	     * Docu to be done.
-	     * @param regAddr
-	     * @param val
-	     * @param mask
-	     * @param shift
+	     * Writes a shadow register to the sensor if it is dirty.
+	     * @param index LTR303ALS01_SHADOW_X
+	     * @return 1 if I2C communication was successful
 	     */
-        void _writeRegister(BB_LTR303ALS01_REGISTER regAddr, uint8_t val, uint8_t mask, uint8_t shift);
-
-		//void _readStatus(void);
+	    int8_t _commitRegister(uint8_t index);
 
 };
 
@@ -9,56 +9,149 @@
 
 // public:
 
-BB_ML8511::BB_ML8511(){
+BB_ML8511::BB_ML8511(BB_ADC *adc){
+	this->_adc = adc;
+	this->_settleTime = 0;
 	this->_init();
 }
 
 uint16_t BB_ML8511::readUvLevel(void){
 	uint16_t uvLevel;
-	BB_ML8511_enable;
-	_delay_ms(100); // TODO - skip and replace by dummy measurement
-	//dummy measurement
-	//_adcRead(BB_ML8511_muxChannel);
-	//real measurement
-	uvLevel = this->_adcRead(BB_ML8511_muxChannel);
-	BB_ML8511_disable;
+	this->_settleBlocking();
+	uvLevel = this->_adc->read(BB_ML8511_muxChannel);
+	this->powerOff();
 	return uvLevel;
 }
 
 uint16_t BB_ML8511::readUvLevel(uint8_t measurementCount){
-	uint16_t uvLevel = 0;
-	BB_ML8511_enable;
-	_delay_ms(10); // TODO - skip and replace by dummy measurement
+	uint32_t uvSum = 0;
+	this->_settleBlocking();
 	for (uint8_t i = 0; i < measurementCount; i++){
-		uvLevel = uvLevel + this->_adcRead(BB_ML8511_muxChannel);
+		uvSum += this->_adc->read(BB_ML8511_muxChannel);
+	}
+	this->powerOff();
+	// rounded average
+	return (uint16_t) ((uvSum + measurementCount / 2) / measurementCount);
+}
+
+uint16_t BB_ML8511::readUvLevelOversampled(uint8_t bits){
+	uint32_t uvSum = 0;
+	uint16_t count;
+	uint8_t shift;
+
+	if (bits < BB_ML8511_RESOLUTION_MIN) bits = BB_ML8511_RESOLUTION_MIN;
+	if (bits > BB_ML8511_RESOLUTION_MAX) bits = BB_ML8511_RESOLUTION_MAX;
+	shift = bits - BB_ML8511_RESOLUTION_MIN;
+	count = (uint16_t) 1 << (2 * shift);  // 4^shift, at most 256 -> the sum fits 18 bit
+
+	this->_settleBlocking();
+	for (uint16_t i = 0; i < count; i++){
+		uvSum += this->_adc->read(BB_ML8511_muxChannel);
 	}
+	this->powerOff();
+	return (uint16_t) (uvSum >> shift);
+}
+
+uint32_t BB_ML8511::getOversamplingTime(uint8_t bits){
+	uint8_t shift;
+
+	if (bits < BB_ML8511_RESOLUTION_MIN) bits = BB_ML8511_RESOLUTION_MIN;
+	if (bits > BB_ML8511_RESOLUTION_MAX) bits = BB_ML8511_RESOLUTION_MAX;
+	shift = bits - BB_ML8511_RESOLUTION_MIN;
+	return this->_adc->getConversionTime((uint16_t) 1 << (2 * shift));
+}
+
+void BB_ML8511::powerOn(void){
+	BB_ML8511_enable;
+}
+
+void BB_ML8511::powerOff(void){
 	BB_ML8511_disable;
-	return (uvLevel / measurementCount);
 }
 
-// private:
+uint16_t BB_ML8511::calculateIntensity(uint16_t level, uint16_t supply){
+	uint32_t voltage = ((uint32_t) level * supply + 512) >> 10;  // mV
 
-int8_t BB_ML8511::_init(void){
-	BB_ML8511_setPort2Out;
-    BB_ML8511_disable; //TODO check if this improves power saving????????
-	this->_adcInit();
-	return 1;
+	if (voltage <= BB_ML8511_OUTPUT_DARK_MV) return 0;
+	return (uint16_t) (((voltage - BB_ML8511_OUTPUT_DARK_MV) * BB_ML8511_INTENSITY_FULL
+	                    + (BB_ML8511_OUTPUT_FULL_MV - BB_ML8511_OUTPUT_DARK_MV) / 2)
+	                   / (BB_ML8511_OUTPUT_FULL_MV - BB_ML8511_OUTPUT_DARK_MV));
 }
 
-void BB_ML8511::_adcInit(void){
-	ADMUX |= (1<<REFS0); // Select Vref=AVcc
-	//ADCSRA |= (1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0)|(1<<ADEN); //set prescaller to 128 and enable ADC
-	ADCSRA |= (1<<ADPS1)|(1<<ADPS0)|(1<<ADEN); //set prescaler to 128 and enable ADC
+uint16_t BB_ML8511::calculateUvIndex(uint16_t intensity){
+	return (uint16_t) (((uint32_t) intensity * BB_ML8511_UV_INDEX_SCALE + 50) / 100);
 }
 
-uint16_t BB_ML8511::_adcRead(uint8_t channel){
-	//select ADC channel with safety mask
-	ADMUX = (ADMUX & 0xF0) | (channel & 0x0F);
-	//single conversion mode
-	ADCSRA |= (1<<ADSC);
-	// wait until ADC conversion is complete
-	while( ADCSRA & (1<<ADSC) );
-	return ADC;
+void BB_ML8511::startSettling(uint16_t now){
+	this->powerOn();
+	this->_settleStart = now;
+	this->_settlePoll = now;
+	this->_settleLast = 0xFFFF;  // no sample yet
+	this->_settleStable = 0;
+	this->startConversion();
 }
 
+int8_t BB_ML8511::settle(uint16_t now){
+	uint16_t level;
+	uint16_t difference;
+	uint16_t elapsed = now - this->_settleStart;
 
+	// one sample per ms, the conversion is started in the previous ms
+	if ((now == this->_settlePoll) || this->isConverting()) return 0;
+	this->_settlePoll = now;
+
+	level = this->readConversion();
+	if (this->_settleLast != 0xFFFF){
+		difference = (level > this->_settleLast) ? level - this->_settleLast : this->_settleLast - level;
+		if (difference <= BB_ML8511_SETTLE_TOLERANCE){
+			if (++this->_settleStable >= BB_ML8511_SETTLE_COUNT){
+				this->_settleTime = elapsed;
+				return 1;
+			}
+		} else {
+			this->_settleStable = 0;
+		}
+	}
+	this->_settleLast = level;
+
+	if (elapsed >= BB_ML8511_SETTLE_TIME_MAX_MS){
+		this->_settleTime = elapsed;
+		return -1;
+	}
+	this->startConversion();
+	return 0;
+}
+
+uint16_t BB_ML8511::getSettleTime(void){
+	return this->_settleTime;
+}
+
+void BB_ML8511::startConversion(void){
+	this->_adc->startConversion(BB_ML8511_muxChannel);
+}
+
+uint8_t BB_ML8511::isConverting(void){
+	return this->_adc->isConverting();
+}
+
+uint16_t BB_ML8511::readConversion(void){
+	return this->_adc->readConversion();
+}
+
+// private:
+
+void BB_ML8511::_settleBlocking(void){
+	uint16_t now = 0;
+
+	this->startSettling(now);
+	do {
+		_delay_ms(1);
+		now++;
+	} while (this->settle(now) == 0);
+}
+
+int8_t BB_ML8511::_init(void){
+	BB_ML8511_setPort2Out;
+    BB_ML8511_disable; //TODO check if this improves power saving????????
+	return 1;
+}
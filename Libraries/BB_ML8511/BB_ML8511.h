@@ -13,14 +13,40 @@ extern "C" {
 	#include <util/delay.h> // TODO remove??
 }
 
+#include <BB_ADC.h>
+
 #ifndef BB_ML8511_H_
 #define BB_ML8511_H_
 
+#ifndef F_CPU
+    #define F_CPU 8000000UL
+#endif
+
 #define BB_ML8511_setPort2Out DDRD |= (1 << PD6)
 #define BB_ML8511_enable PORTD |= (1 << PD6)
 #define BB_ML8511_disable PORTD &= ~(1 << PD6)
 #define BB_ML8511_muxChannel 2
 
+// settle detection: after enabling the sensor the output is sampled once per
+// ms until BB_ML8511_SETTLE_COUNT consecutive samples differ by at most
+// BB_ML8511_SETTLE_TOLERANCE (ADC levels), but at most BB_ML8511_SETTLE_TIME_MAX_MS
+#define BB_ML8511_SETTLE_TOLERANCE 2
+#define BB_ML8511_SETTLE_COUNT 2
+#define BB_ML8511_SETTLE_TIME_MAX_MS 20
+
+// the output of the ML8511 is linear from 0.99V at 0 mW/cm2 to 2.8V at 15 mW/cm2
+#define BB_ML8511_OUTPUT_DARK_MV 990
+#define BB_ML8511_OUTPUT_FULL_MV 2800
+#define BB_ML8511_INTENSITY_FULL 1500  // 0.01 mW/cm2
+
+// UV index * 10 per mW/cm2. The sensor is not erythemally weighted, this is
+// an approximation for sunlight (about 5 mW/cm2 at UV index 10).
+#define BB_ML8511_UV_INDEX_SCALE 20
+
+// resolution of the oversampling, 4^(bits - 10) conversions per value
+#define BB_ML8511_RESOLUTION_MIN 10
+#define BB_ML8511_RESOLUTION_MAX 14
+
 /**
  * Objects of this class represent a ML8511
  */
@@ -28,8 +54,9 @@ class BB_ML8511{
 	public:
 	    /**
 	     * Initializes a ML8511 object.
+	     * @param adc a reference to the ADC object.
 	     */
-	    BB_ML8511();
+	    BB_ML8511(BB_ADC *adc);
 
 	    // TODO remove
 		//bool begin(void);
@@ -47,32 +74,117 @@ class BB_ML8511{
 		 */
 		uint16_t readUvLevel(uint8_t measurementCount); // output of the adc converter -> convert to voltage using (3.3V / 1024 * level)
 
+		/**
+		 * Reads the UV signal with a resolution above the 10 bit of the ADC
+		 * (oversampling and decimation): 4^(bits - 10) conversions are summed
+		 * and the sum is shifted right by (bits - 10). This needs noise of
+		 * at least 1 LSB on the signal, which the sensor output has.
+		 * @param bits the resolution, BB_ML8511_RESOLUTION_MIN .. BB_ML8511_RESOLUTION_MAX
+		 * @return the UV signal with the resolution of bits (full scale 2^bits - 1)
+		 */
+		uint16_t readUvLevelOversampled(uint8_t bits);
+
+		/**
+		 * Calculates the conversion time of readUvLevelOversampled() (without
+		 * the settle time of the sensor).
+		 * @param bits the resolution, BB_ML8511_RESOLUTION_MIN .. BB_ML8511_RESOLUTION_MAX
+		 * @return the conversion time in us
+		 */
+		uint32_t getOversamplingTime(uint8_t bits);
+
+		/**
+		 * Calculates the UV intensity (fixed point).
+		 * @param level the UV signal (10 bit ADC level)
+		 * @param supply the supply voltage in mV (BB_ADC::readSupplyVoltage())
+		 * @return the UV intensity in 0.01 mW/cm2
+		 */
+		static uint16_t calculateIntensity(uint16_t level, uint16_t supply);
+
+		/**
+		 * Calculates the UV index from the UV intensity (fixed point).
+		 * @param intensity the UV intensity in 0.01 mW/cm2
+		 * @return the UV index * 10
+		 */
+		static uint16_t calculateUvIndex(uint16_t intensity);
+
+		/**
+		 * Enables the sensor. The output has to settle, see startSettling().
+		 * This and the following functions do not block - they allow other work
+		 * while the sensor settles and the ADC converts.
+		 */
+		void powerOn(void);
+
+		/**
+		 * Enables the sensor and starts the settle detection.
+		 * @param now the current time in ms
+		 */
+		void startSettling(uint16_t now);
+
+		/**
+		 * Advances the settle detection. Has to be called until it returns
+		 * a value != 0, a new sample is taken when the time has advanced.
+		 * @param now the current time in ms
+		 * @return 1 if the output is stable, 0 if it is settling, -1 if it
+		 * did not settle within BB_ML8511_SETTLE_TIME_MAX_MS
+		 */
+		int8_t settle(uint16_t now);
+
+		/**
+		 * Provides the time the output needed to settle the last time.
+		 * @return the settle time in ms
+		 */
+		uint16_t getSettleTime(void);
+
+		/**
+		 * Disables the sensor.
+		 */
+		void powerOff(void);
+
+		/**
+		 * Starts one ADC conversion of the UV signal. The ADC interrupt
+		 * wakes the controller from idle sleep when the conversion is complete.
+		 */
+		void startConversion(void);
+
+		/**
+		 * Checks if the ADC conversion is running.
+		 * @return 1 if the ADC is converting, 0 otherwise
+		 */
+		uint8_t isConverting(void);
+
+		/**
+		 * Provides the result of the last conversion.
+		 * @return the UV signal
+		 */
+		uint16_t readConversion(void);
+
 	private:
 		/**
-		 * Initiates the ADC of the Atmega328P
+		 * The state of the settle detection: the start time, the time of the
+		 * last sample, the last sample, the number of stable samples and the
+		 * measured settle time.
+		 */
+		uint16_t _settleStart;
+		uint16_t _settlePoll;
+		uint16_t _settleLast;
+		uint8_t _settleStable;
+		uint16_t _settleTime;
+
+		/**
+		 * The ADC object used for the conversions.
 		 */
-	    void _adcInit();
+		BB_ADC *_adc;
 
-		uint16_t _adcRead(uint8_t channel);
+		/**
+		 * Enables the sensor and waits until its output is stable.
+		 */
+		void _settleBlocking(void);
 
 		/**
-		 * Initiates the Atmega328P for ADC and calls _adcInit()
+		 * Initiates the port of the sensor
 		 * @return 1
 		 */
 		int8_t _init();
 };
 
-/*
-//Convert the voltage to a UV intensity level(!!!)
-// outputVoltage = readUvLevel
-mapfloat(outputVoltage, 0.99, 2.8, 0.0, 15.0);
-//From: http://forum.arduino.cc/index.php?topic=3922.0
-float mapfloat(float x, float in_min, float in_max, float out_min, float out_max)
-{
-	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
-*/
-
-
-
 #endif /* BB_ML8511_H_ */
@@ -0,0 +1,148 @@
+/*
+ * BB_SAMPLELOG.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include "BB_SAMPLELOG.h"
+
+// the ring buffer of blocks (there is only one), _blocks[_tail] is the oldest
+// block, the last used block is being filled
+static uint8_t _blocks[BB_SAMPLELOG_BLOCKS][BB_SAMPLELOG_BLOCK_SIZE];
+static uint8_t _lengths[BB_SAMPLELOG_BLOCKS];
+static uint8_t _records[BB_SAMPLELOG_BLOCKS];
+static volatile uint8_t _tail = 0;
+static volatile uint8_t _blockCount = 0;
+static volatile uint16_t _count = 0;
+static volatile uint16_t _lost = 0;
+
+// the last record, the next one is encoded as difference
+static BB_SAMPLELOG_RECORD _previous;
+
+// the running bulk read
+static volatile uint8_t _streaming = 0;
+static uint8_t _streamHeader;
+static uint16_t _streamLength;
+static uint8_t _streamBlock;
+static uint8_t _streamByte;
+
+BB_SAMPLELOG::BB_SAMPLELOG(){
+	this->clear();
+}
+
+int8_t BB_SAMPLELOG::append(const BB_SAMPLELOG_RECORD &record){
+	uint8_t delta[BB_SAMPLELOG_CODEC_MAX_SIZE];
+	uint8_t keyframe[BB_SAMPLELOG_CODEC_MAX_SIZE];
+	uint8_t deltaLen;
+	uint8_t keyframeLen;
+	uint8_t *data;
+	uint8_t len;
+	uint8_t block;
+	int8_t r_val = 1;
+
+	// encode both variants beforehand, a completed bulk read may empty the
+	// blocks until the atomic section
+	deltaLen = BB_SAMPLELOG_encode(record, &_previous, delta);
+	keyframeLen = BB_SAMPLELOG_encode(record, 0, keyframe);
+
+	// the check for a bulk read and all changes of the blocks in one section
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (_streaming){
+			// the blocks are being read
+			_lost++;
+			r_val = -1;
+		} else {
+			block = (_tail + _blockCount + BB_SAMPLELOG_BLOCKS - 1) % BB_SAMPLELOG_BLOCKS;
+			data = delta;
+			len = deltaLen;
+			if ((_blockCount == 0) || (_lengths[block] + len > BB_SAMPLELOG_BLOCK_SIZE)){
+				// start a new block with a keyframe
+				if (_blockCount == BB_SAMPLELOG_BLOCKS){
+					_count -= _records[_tail];
+					_lost += _records[_tail];
+					_tail = (_tail + 1) % BB_SAMPLELOG_BLOCKS;
+					_blockCount--;
+				}
+				block = (_tail + _blockCount) % BB_SAMPLELOG_BLOCKS;
+				_lengths[block] = 0;
+				_records[block] = 0;
+				_blockCount++;
+				data = keyframe;
+				len = keyframeLen;
+			}
+			for (uint8_t i = 0; i < len; i++) _blocks[block][_lengths[block] + i] = data[i];
+			_lengths[block] += len;
+			_records[block]++;
+			_count++;
+		}
+	}
+	if (r_val == 1) _previous = record;
+	return r_val;
+}
+
+uint16_t BB_SAMPLELOG::count(void){
+	uint16_t count;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		count = _count;
+	}
+	return count;
+}
+
+uint16_t BB_SAMPLELOG::getLost(void){
+	uint16_t lost;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		lost = _lost;
+	}
+	return lost;
+}
+
+void BB_SAMPLELOG::clear(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		_tail = 0;
+		_blockCount = 0;
+		_count = 0;
+		_lost = 0;
+		_streaming = 0;
+	}
+}
+
+uint16_t BB_SAMPLELOG::streamBegin(void){
+	uint16_t length;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		_streaming = 1;
+		_streamLength = 0;
+		for (uint8_t n = 0; n < _blockCount; n++) _streamLength += _lengths[(_tail + n) % BB_SAMPLELOG_BLOCKS];
+		_streamHeader = 0;
+		_streamBlock = _tail;
+		_streamByte = 0;
+		length = BB_SAMPLELOG_HEADER_SIZE + _streamLength;
+	}
+	return length;
+}
+
+uint8_t BB_SAMPLELOG::streamNext(void){
+	uint8_t data;
+
+	// called in the ISR for each byte - no division here
+	if (_streamHeader < BB_SAMPLELOG_HEADER_SIZE){
+		return (_streamHeader++ == 0) ? (uint8_t) (_streamLength >> 8) : (uint8_t) _streamLength;
+	}
+	data = _blocks[_streamBlock][_streamByte];
+	if (++_streamByte == _lengths[_streamBlock]){
+		_streamByte = 0;
+		if (++_streamBlock == BB_SAMPLELOG_BLOCKS) _streamBlock = 0;
+	}
+	return data;
+}
+
+void BB_SAMPLELOG::streamEnd(uint8_t complete){
+	if (complete){
+		// the next record starts a new block with a keyframe
+		_tail = 0;
+		_blockCount = 0;
+		_count = 0;
+	}
+	_streaming = 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * BB_SAMPLELOG.h - A library providing a ring buffer of compact sample records
+ * in RAM, read out in one bulk transfer.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+extern "C" {
+    #include <stdint.h>
+    #include <util/atomic.h>
+}
+
+#include "BB_SAMPLELOG_CODEC.h"
+
+#ifndef BB_SAMPLELOG_H_
+#define BB_SAMPLELOG_H_
+
+// the records are stored in blocks, each block starts with a keyframe.
+// When the log is full, the oldest block is overwritten.
+#ifndef BB_SAMPLELOG_BLOCKS
+    #define BB_SAMPLELOG_BLOCKS 10
+#endif
+#ifndef BB_SAMPLELOG_BLOCK_SIZE
+    #define BB_SAMPLELOG_BLOCK_SIZE 64
+#endif
+
+#if BB_SAMPLELOG_BLOCK_SIZE < BB_SAMPLELOG_CODEC_MAX_SIZE
+    #error "BB_SAMPLELOG_BLOCK_SIZE is too small for a keyframe"
+#endif
+
+// size of the header of a bulk read (number of bytes)
+#define BB_SAMPLELOG_HEADER_SIZE 2
+
+/**
+ * Objects of this class provide access to the ring buffer (there is only
+ * one). The records are stored in the compact format of BB_SAMPLELOG_CODEC,
+ * a slowly changing sample needs about 5 bytes.
+ * The records are read out with the stream functions, which are
+ * meant for BB_SPI::setStream(): a bulk read consists of the number of
+ * bytes (2 bytes, MSB first) followed by the encoded records, oldest first.
+ * The first record is a keyframe, so the master decodes the records one
+ * after the other with BB_SAMPLELOG_decode().
+ * The records are removed when the bulk read is complete, an aborted bulk
+ * read keeps them.
+ */
+class BB_SAMPLELOG{
+
+	public:
+	    /**
+	     * Initializes a BB_SAMPLELOG object.
+	     */
+	    BB_SAMPLELOG();
+
+	    /**
+	     * Appends a record. When the buffer is full, the oldest block of records
+	     * is overwritten - except during a bulk read, then the record is dropped.
+	     * @param record the sample
+	     * @return 1 if the record was stored, -1 if it was dropped
+	     */
+	    int8_t append(const BB_SAMPLELOG_RECORD &record);
+
+	    /**
+	     * Provides the number of stored records.
+	     * @return the number of records
+	     */
+	    uint16_t count(void);
+
+	    /**
+	     * Provides the number of records which were overwritten or dropped.
+	     * @return the number of lost records
+	     */
+	    uint16_t getLost(void);
+
+	    /**
+	     * Removes all records.
+	     */
+	    void clear(void);
+
+	    /**
+	     * Starts a bulk read of all records stored now.
+	     * @return the number of bytes of the bulk read
+	     */
+	    static uint16_t streamBegin(void);
+
+	    /**
+	     * Provides the next byte of the bulk read.
+	     * @return the byte
+	     */
+	    static uint8_t streamNext(void);
+
+	    /**
+	     * Completes the bulk read.
+	     * @param complete 1 if all bytes were read - the records are removed,
+	     *        0 if the bulk read was aborted - the records are kept
+	     */
+	    static void streamEnd(uint8_t complete);
+};
+
+#endif /* BB_SAMPLELOG_H_ */
@@ -0,0 +1,200 @@
+/*
+ * BB_SAMPLELOG_CODEC.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include "BB_SAMPLELOG_CODEC.h"
+
+// The differences are calculated modulo the width of the field, so the
+// decoder restores every value exactly, even if a counter wraps around.
+// The zigzag mapping (0, -1, 1, -2, ...) -> (0, 1, 2, 3, ...) keeps small
+// negative differences small, the varint packing stores 7 bits per byte
+// with bit 7 set if another byte follows.
+
+static uint8_t _putVarint(uint8_t *data, uint32_t value){
+	uint8_t n = 0;
+	while (value > 0x7F){
+		data[n++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	data[n++] = (uint8_t) value;
+	return n;
+}
+
+/**
+ * Reads a varint.
+ * @return the number of bytes, 0 if data is truncated or the value is too long
+ */
+static uint8_t _getVarint(const uint8_t *data, uint16_t len, uint32_t &value){
+	uint8_t n = 0;
+	uint8_t shift = 0;
+	value = 0;
+	do {
+		if ((n >= len) || (shift > 28)) return 0;
+		value |= ((uint32_t) (data[n] & 0x7F)) << shift;
+		shift += 7;
+	} while (data[n++] & 0x80);
+	return n;
+}
+
+static inline uint32_t _zigzag16(uint16_t delta){
+	int16_t d = (int16_t) delta;
+	return (uint16_t) ((uint16_t) (d << 1) ^ (uint16_t) (d >> 15));
+}
+
+static inline uint16_t _unzigzag16(uint32_t value){
+	return (uint16_t) ((value >> 1) ^ (0 - (value & 1)));
+}
+
+static inline uint32_t _zigzag32(uint32_t delta){
+	int32_t d = (int32_t) delta;
+	return ((uint32_t) d << 1) ^ (uint32_t) (d >> 31);
+}
+
+static inline uint32_t _unzigzag32(uint32_t value){
+	return (value >> 1) ^ (0 - (value & 1));
+}
+
+uint8_t BB_SAMPLELOG_encode(const BB_SAMPLELOG_RECORD &record,
+                            const BB_SAMPLELOG_RECORD *previous, uint8_t *data){
+	uint8_t n = 1;
+	uint16_t dT, dH, dUv, dSupply, dMcuT;
+	uint32_t dP, dLux;
+
+	if (!previous){
+		data[0] = BB_SAMPLELOG_CODEC_KEYFRAME;
+		data[n++] = record.status;
+		n += _putVarint(&data[n], record.sequence);
+		n += _putVarint(&data[n], _zigzag16((uint16_t) record.temperature));
+		n += _putVarint(&data[n], record.pressure);
+		n += _putVarint(&data[n], record.humidity);
+		n += _putVarint(&data[n], record.lux);
+		n += _putVarint(&data[n], record.uvLevel);
+		n += _putVarint(&data[n], record.supply);
+		n += _putVarint(&data[n], _zigzag16((uint16_t) record.mcuTemperature));
+		return n;
+	}
+
+	data[0] = 0x00;
+	if ((record.status != previous->status) || ((uint16_t) (record.sequence - previous->sequence) != 1)){
+		data[0] |= BB_SAMPLELOG_CODEC_EXTENDED;
+		data[n++] = record.status;
+		n += _putVarint(&data[n], (uint16_t) (record.sequence - previous->sequence));
+	}
+
+	dT = (uint16_t) record.temperature - (uint16_t) previous->temperature;
+	dP = record.pressure - previous->pressure;
+	dH = record.humidity - previous->humidity;
+	dLux = record.lux - previous->lux;
+	dUv = record.uvLevel - previous->uvLevel;
+	dSupply = record.supply - previous->supply;
+	dMcuT = (uint16_t) record.mcuTemperature - (uint16_t) previous->mcuTemperature;
+
+	if (dT){
+		data[0] |= BB_SAMPLELOG_CODEC_TEMPERATURE;
+		n += _putVarint(&data[n], _zigzag16(dT));
+	}
+	if (dP){
+		data[0] |= BB_SAMPLELOG_CODEC_PRESSURE;
+		n += _putVarint(&data[n], _zigzag32(dP));
+	}
+	if (dH){
+		data[0] |= BB_SAMPLELOG_CODEC_HUMIDITY;
+		n += _putVarint(&data[n], _zigzag16(dH));
+	}
+	if (dLux){
+		data[0] |= BB_SAMPLELOG_CODEC_LUX;
+		n += _putVarint(&data[n], _zigzag32(dLux));
+	}
+	if (dUv){
+		data[0] |= BB_SAMPLELOG_CODEC_UV;
+		n += _putVarint(&data[n], _zigzag16(dUv));
+	}
+	if (dSupply || dMcuT){
+		data[0] |= BB_SAMPLELOG_CODEC_MCU;
+		n += _putVarint(&data[n], _zigzag16(dSupply));
+		n += _putVarint(&data[n], _zigzag16(dMcuT));
+	}
+	return n;
+}
+
+uint8_t BB_SAMPLELOG_decode(const uint8_t *data, uint16_t len, BB_SAMPLELOG_RECORD &record){
+	uint8_t n = 1;
+	uint8_t m;
+	uint8_t header;
+	uint32_t value;
+	// decoded into a copy, the record is only changed by a complete record
+	BB_SAMPLELOG_RECORD decoded = record;
+
+	if (len < 1) return 0;
+	header = data[0];
+
+	// reads the next varint into value, returns 0 if data is truncated
+	#define BB_SAMPLELOG_NEXT() \
+		if ((m = _getVarint(&data[n], len - n, value)) == 0) return 0; \
+		n += m
+
+	if (header & BB_SAMPLELOG_CODEC_KEYFRAME){
+		if (len < 2) return 0;
+		decoded.status = data[n++];
+		BB_SAMPLELOG_NEXT();
+		decoded.sequence = (uint16_t) value;
+		BB_SAMPLELOG_NEXT();
+		decoded.temperature = (int16_t) _unzigzag16(value);
+		BB_SAMPLELOG_NEXT();
+		decoded.pressure = value;
+		BB_SAMPLELOG_NEXT();
+		decoded.humidity = (uint16_t) value;
+		BB_SAMPLELOG_NEXT();
+		decoded.lux = value;
+		BB_SAMPLELOG_NEXT();
+		decoded.uvLevel = (uint16_t) value;
+		BB_SAMPLELOG_NEXT();
+		decoded.supply = (uint16_t) value;
+		BB_SAMPLELOG_NEXT();
+		decoded.mcuTemperature = (int16_t) _unzigzag16(value);
+		record = decoded;
+		return n;
+	}
+
+	if (header & BB_SAMPLELOG_CODEC_EXTENDED){
+		if (len < 2) return 0;
+		decoded.status = data[n++];
+		BB_SAMPLELOG_NEXT();
+		decoded.sequence += (uint16_t) value;
+	} else {
+		decoded.sequence++;
+	}
+	if (header & BB_SAMPLELOG_CODEC_TEMPERATURE){
+		BB_SAMPLELOG_NEXT();
+		decoded.temperature = (int16_t) ((uint16_t) decoded.temperature + _unzigzag16(value));
+	}
+	if (header & BB_SAMPLELOG_CODEC_PRESSURE){
+		BB_SAMPLELOG_NEXT();
+		decoded.pressure += _unzigzag32(value);
+	}
+	if (header & BB_SAMPLELOG_CODEC_HUMIDITY){
+		BB_SAMPLELOG_NEXT();
+		decoded.humidity += _unzigzag16(value);
+	}
+	if (header & BB_SAMPLELOG_CODEC_LUX){
+		BB_SAMPLELOG_NEXT();
+		decoded.lux += _unzigzag32(value);
+	}
+	if (header & BB_SAMPLELOG_CODEC_UV){
+		BB_SAMPLELOG_NEXT();
+		decoded.uvLevel += _unzigzag16(value);
+	}
+	if (header & BB_SAMPLELOG_CODEC_MCU){
+		BB_SAMPLELOG_NEXT();
+		decoded.supply += _unzigzag16(value);
+		BB_SAMPLELOG_NEXT();
+		decoded.mcuTemperature = (int16_t) ((uint16_t) decoded.mcuTemperature + _unzigzag16(value));
+	}
+	record = decoded;
+	return n;
+
+	#undef BB_SAMPLELOG_NEXT
+}
@@ -0,0 +1,74 @@
+/**
+ * BB_SAMPLELOG_CODEC.h - The compact record format of the sample log. Each
+ * field is stored as the difference to the previous record (zigzag and
+ * varint packed), unchanged fields are skipped. A keyframe contains the
+ * absolute values and starts each block of the log.
+ * This part of the library depends on stdint.h only, so the decoder can be
+ * used on the master or any host.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+#include <stdint.h>
+
+#ifndef BB_SAMPLELOG_CODEC_H_
+#define BB_SAMPLELOG_CODEC_H_
+
+// maximum size of an encoded record in bytes
+#define BB_SAMPLELOG_CODEC_MAX_SIZE 30
+
+// version of the format, stored data of another version is not decoded
+#define BB_SAMPLELOG_CODEC_VERSION 3
+
+// the first byte of an encoded record:
+// bit 7 - keyframe: status, sequence and all fields as absolute values follow
+// bit 6 - (no keyframe) status and the sequence difference follow, otherwise
+//         the status is unchanged and the sequence is incremented by 1
+// bit 0..5 - (no keyframe) the fields with a difference != 0 follow
+#define BB_SAMPLELOG_CODEC_KEYFRAME 0x80
+#define BB_SAMPLELOG_CODEC_EXTENDED 0x40
+#define BB_SAMPLELOG_CODEC_TEMPERATURE 0x01
+#define BB_SAMPLELOG_CODEC_PRESSURE 0x02
+#define BB_SAMPLELOG_CODEC_HUMIDITY 0x04
+#define BB_SAMPLELOG_CODEC_LUX 0x08
+#define BB_SAMPLELOG_CODEC_UV 0x10
+#define BB_SAMPLELOG_CODEC_MCU 0x20  // supply voltage and MCU temperature
+
+/**
+ * One sample.
+ */
+typedef struct{
+	uint16_t sequence;   // incremented with each sample
+	int16_t temperature; // 0.01 degC
+	uint32_t pressure;   // Pa
+	uint16_t humidity;   // 0.01 %RH
+	uint32_t lux;        // 0.01 lx
+	uint16_t uvLevel;    // adc level
+	uint16_t supply;     // mV
+	int16_t mcuTemperature; // 0.1 degC
+	uint8_t status;      // valid values, see BB_EVS
+} BB_SAMPLELOG_RECORD;
+
+/**
+ * Encodes a record.
+ * @param record the record
+ * @param previous the previous record, 0 for a keyframe
+ * @param data takes at least BB_SAMPLELOG_CODEC_MAX_SIZE bytes
+ * @return the number of bytes of the encoded record
+ */
+uint8_t BB_SAMPLELOG_encode(const BB_SAMPLELOG_RECORD &record,
+                            const BB_SAMPLELOG_RECORD *previous, uint8_t *data);
+
+/**
+ * Decodes a record.
+ * @param data the encoded record
+ * @param len the number of available bytes
+ * @param record the previous record before the call (not used for a
+ *        keyframe), the decoded record after the call. Unchanged if 0 is returned.
+ * @return the number of bytes of the encoded record, 0 if data is truncated
+ */
+uint8_t BB_SAMPLELOG_decode(const uint8_t *data, uint16_t len, BB_SAMPLELOG_RECORD &record);
+
+#endif /* BB_SAMPLELOG_CODEC_H_ */
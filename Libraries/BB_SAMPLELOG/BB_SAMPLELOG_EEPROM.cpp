@@ -0,0 +1,303 @@
+/*
+ * BB_SAMPLELOG_EEPROM.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include "BB_SAMPLELOG_EEPROM.h"
+
+// the pages in the EEPROM (there is only one log): length of the data of
+// each page (0 for an invalid page) and its sequence
+static volatile uint8_t _pageLength[BB_SAMPLELOG_EEPROM_PAGES];
+static volatile uint16_t _pageSequence[BB_SAMPLELOG_EEPROM_PAGES];
+// the page written next (the oldest one) and its sequence
+static uint8_t _nextPage = 0;
+static uint16_t _nextSequence = 0;
+
+// the page buffer, it starts with a keyframe
+static uint8_t _buffer[BB_SAMPLELOG_EEPROM_DATA_SIZE];
+static uint8_t _bufferLength = 0;
+static BB_SAMPLELOG_RECORD _previous;
+
+// the page written in the background by ISR(EE_READY_vect): the image of
+// the page (header and data), the data is written first, the header with
+// the CRC last
+static uint8_t _image[BB_SAMPLELOG_EEPROM_PAGE_SIZE];
+static uint8_t _writingPage;
+static uint8_t _writeLength;
+static uint8_t _writeIndex;
+static volatile uint8_t _writing = 0;
+
+// the pages up to this sequence have been read completely
+static uint16_t _readSequence = 0;
+static uint8_t _readValid = 0;
+
+// the running bulk read
+static volatile uint8_t _streaming = 0;
+// set while the main context accesses the EEPROM. A read from the SPI ISR
+// would change EEAR in the middle of the access, so the bulk read is empty.
+static volatile uint8_t _eepromBusy = 0;
+static uint8_t _streamEmpty;
+static uint8_t _streamHeader;
+static uint16_t _streamLength;
+static uint8_t _streamPage;
+static uint8_t _streamCount;
+static uint8_t _streamOffset;
+static uint16_t _streamNewest;
+
+static inline uint8_t *_pageAddr(uint8_t page){
+	return (uint8_t *) (BB_SAMPLELOG_EEPROM_ADDR + (uint16_t) page * BB_SAMPLELOG_EEPROM_PAGE_SIZE);
+}
+
+/**
+ * Checks if a page is sent by a bulk read.
+ */
+static inline uint8_t _isUnread(uint8_t page){
+	if (_pageLength[page] == 0) return 0;
+	return (!_readValid) || ((int16_t) (_pageSequence[page] - _readSequence) > 0);
+}
+
+/**
+ * Reserves the EEPROM for the main context.
+ * @return 1 if successful, 0 if a bulk read is running
+ */
+static uint8_t _lock(void){
+	uint8_t r_val = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (!_streaming){
+			_eepromBusy = 1;
+			r_val = 1;
+		}
+	}
+	return r_val;
+}
+
+static inline void _unlock(void){
+	_eepromBusy = 0;
+}
+
+// One byte per interrupt: the EEPROM ready interrupt fires as long as
+// EERIE is set and no write is running. Bytes which are stored already are
+// skipped (like eeprom_update_block()), they are not worn out. The ISR is
+// short, the SPI interrupt (higher priority) is served in between.
+ISR(EE_READY_vect){
+	uint8_t *addr = _pageAddr(_writingPage);
+	uint8_t pos;
+
+	if (_writeIndex < _writeLength + BB_SAMPLELOG_EEPROM_HEADER_SIZE){
+		pos = (_writeIndex < _writeLength) ? BB_SAMPLELOG_EEPROM_HEADER_SIZE + _writeIndex
+		                                   : _writeIndex - _writeLength;
+		_writeIndex++;
+		if (eeprom_read_byte(addr + pos) != _image[pos]) eeprom_write_byte(addr + pos, _image[pos]);
+		return;
+	}
+
+	// the CRC is written -> the page is valid
+	EECR &= ~(1 << EERIE);
+	_pageLength[_writingPage] = _writeLength;
+	_pageSequence[_writingPage] = ((uint16_t) _image[0] << 8) | _image[1];
+	_writing = 0;
+}
+
+/**
+ * Waits until the page written in the background is complete. The
+ * controller sleeps in the idle mode, the EEPROM ready interrupt wakes it up.
+ */
+static void _waitWriter(void){
+	uint8_t sreg = SREG;
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while (_writing){
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	SREG = sreg;
+}
+
+/**
+ * Starts writing the page buffer to the next page in the background. The
+ * EEPROM has to be locked.
+ */
+static void _writePage(void){
+	uint16_t crc = _crc_xmodem_update(0, BB_SAMPLELOG_CODEC_VERSION);
+
+	// the image of the previous page is in use until it is written
+	_waitWriter();
+
+	_image[0] = (uint8_t) (_nextSequence >> 8);
+	_image[1] = (uint8_t) _nextSequence;
+	_image[2] = _bufferLength;
+	for (uint8_t i = 0; i < _bufferLength; i++) _image[BB_SAMPLELOG_EEPROM_HEADER_SIZE + i] = _buffer[i];
+	for (uint8_t i = 0; i < 3; i++) crc = _crc_xmodem_update(crc, _image[i]);
+	for (uint8_t i = 0; i < _bufferLength; i++) crc = _crc_xmodem_update(crc, _buffer[i]);
+	_image[3] = (uint8_t) (crc >> 8);
+	_image[4] = (uint8_t) crc;
+
+	// the page is invalid until the CRC is written
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		_pageLength[_nextPage] = 0;
+		_writingPage = _nextPage;
+		_writeLength = _bufferLength;
+		_writeIndex = 0;
+		_writing = 1;
+		EECR |= (1 << EERIE);
+	}
+
+	_nextPage = (_nextPage + 1) % BB_SAMPLELOG_EEPROM_PAGES;
+	_nextSequence++;
+	_bufferLength = 0;
+}
+
+BB_SAMPLELOG_EEPROM::BB_SAMPLELOG_EEPROM(){
+	uint8_t header[BB_SAMPLELOG_EEPROM_HEADER_SIZE];
+	uint8_t *addr;
+	uint16_t crc;
+	uint16_t sequence;
+	uint8_t newest = 0;
+	uint8_t found = 0;
+
+	// recovery scan: find the valid pages and the newest one
+	for (uint8_t page = 0; page < BB_SAMPLELOG_EEPROM_PAGES; page++){
+		addr = _pageAddr(page);
+		eeprom_read_block(header, addr, BB_SAMPLELOG_EEPROM_HEADER_SIZE);
+		_pageLength[page] = 0;
+		if ((header[2] == 0) || (header[2] > BB_SAMPLELOG_EEPROM_DATA_SIZE)) continue;
+
+		crc = _crc_xmodem_update(0, BB_SAMPLELOG_CODEC_VERSION);
+		for (uint8_t i = 0; i < 3; i++) crc = _crc_xmodem_update(crc, header[i]);
+		for (uint8_t i = 0; i < header[2]; i++){
+			crc = _crc_xmodem_update(crc, eeprom_read_byte(addr + BB_SAMPLELOG_EEPROM_HEADER_SIZE + i));
+		}
+		if (crc != (((uint16_t) header[3] << 8) | header[4])) continue;
+
+		sequence = ((uint16_t) header[0] << 8) | header[1];
+		_pageLength[page] = header[2];
+		_pageSequence[page] = sequence;
+		if (!found || ((int16_t) (sequence - _pageSequence[newest]) > 0)) newest = page;
+		found = 1;
+	}
+
+	if (found){
+		_nextPage = (newest + 1) % BB_SAMPLELOG_EEPROM_PAGES;
+		_nextSequence = _pageSequence[newest] + 1;
+	}
+}
+
+int8_t BB_SAMPLELOG_EEPROM::append(const BB_SAMPLELOG_RECORD &record){
+	uint8_t data[BB_SAMPLELOG_CODEC_MAX_SIZE];
+	uint8_t len = 0;
+
+	if (!_lock()) return -1;
+
+	if (_bufferLength > 0){
+		len = BB_SAMPLELOG_encode(record, &_previous, data);
+		if (_bufferLength + len > BB_SAMPLELOG_EEPROM_DATA_SIZE){
+			_writePage();
+			len = 0;
+		}
+	}
+	if (len == 0) len = BB_SAMPLELOG_encode(record, 0, data);
+
+	for (uint8_t i = 0; i < len; i++) _buffer[_bufferLength + i] = data[i];
+	_bufferLength += len;
+	_previous = record;
+	_unlock();
+	return 1;
+}
+
+int8_t BB_SAMPLELOG_EEPROM::flush(void){
+	if (!_lock()) return -1;
+	if (_bufferLength > 0) _writePage();
+	_unlock();
+	return 1;
+}
+
+int8_t BB_SAMPLELOG_EEPROM::readLast(BB_SAMPLELOG_RECORD &record){
+	uint8_t page = (_nextPage + BB_SAMPLELOG_EEPROM_PAGES - 1) % BB_SAMPLELOG_EEPROM_PAGES;
+	uint8_t data[BB_SAMPLELOG_EEPROM_DATA_SIZE];
+	uint8_t pos = 0;
+	uint8_t n;
+
+	if (!_lock()) return -1;
+	_waitWriter();
+	if (_pageLength[page] == 0){
+		_unlock();
+		return -1;
+	}
+
+	// the page starts with a keyframe, the records are decoded one after the other
+	eeprom_read_block(data, _pageAddr(page) + BB_SAMPLELOG_EEPROM_HEADER_SIZE, _pageLength[page]);
+	_unlock();
+	while ((n = BB_SAMPLELOG_decode(&data[pos], _pageLength[page] - pos, record)) > 0) pos += n;
+	return 1;
+}
+
+uint8_t BB_SAMPLELOG_EEPROM::isWriting(void){
+	return _writing;
+}
+
+uint8_t BB_SAMPLELOG_EEPROM::getPages(void){
+	uint8_t count = 0;
+	for (uint8_t page = 0; page < BB_SAMPLELOG_EEPROM_PAGES; page++){
+		if (_pageLength[page] > 0) count++;
+	}
+	return count;
+}
+
+uint16_t BB_SAMPLELOG_EEPROM::streamBegin(void){
+	uint8_t page;
+
+	_streaming = 1;
+	_streamHeader = 0;
+	_streamLength = 0;
+	_streamCount = 0;
+	_streamOffset = 0;
+	_streamPage = _nextPage;
+	_streamNewest = _nextSequence - 1;
+	// the main context accesses the EEPROM or a page is written -> the bulk
+	// read is busy, the master asks again
+	_streamEmpty = _eepromBusy || _writing;
+	if (_streamEmpty){
+		_streamLength = BB_SAMPLELOG_EEPROM_STREAM_BUSY;
+		_streamCount = BB_SAMPLELOG_EEPROM_PAGES;
+		return BB_SAMPLELOG_EEPROM_STREAM_HEADER_SIZE;
+	}
+	for (page = 0; page < BB_SAMPLELOG_EEPROM_PAGES; page++){
+		if (_isUnread(page)) _streamLength += _pageLength[page];
+	}
+	return BB_SAMPLELOG_EEPROM_STREAM_HEADER_SIZE + _streamLength;
+}
+
+uint8_t BB_SAMPLELOG_EEPROM::streamNext(void){
+	uint8_t data;
+
+	if (_streamHeader < BB_SAMPLELOG_EEPROM_STREAM_HEADER_SIZE){
+		return (_streamHeader++ == 0) ? (uint8_t) (_streamLength >> 8) : (uint8_t) _streamLength;
+	}
+
+	// find the next unread page, oldest first
+	while ((_streamCount < BB_SAMPLELOG_EEPROM_PAGES) &&
+	       (!_isUnread(_streamPage) || (_streamOffset >= _pageLength[_streamPage]))){
+		_streamPage = (_streamPage + 1) % BB_SAMPLELOG_EEPROM_PAGES;
+		_streamCount++;
+		_streamOffset = 0;
+	}
+	if (_streamCount >= BB_SAMPLELOG_EEPROM_PAGES) return 0xFF;
+
+	data = eeprom_read_byte(_pageAddr(_streamPage) + BB_SAMPLELOG_EEPROM_HEADER_SIZE + _streamOffset);
+	_streamOffset++;
+	return data;
+}
+
+void BB_SAMPLELOG_EEPROM::streamEnd(uint8_t complete){
+	if (complete && !_streamEmpty){
+		_readSequence = _streamNewest;
+		_readValid = 1;
+	}
+	_streaming = 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * BB_SAMPLELOG_EEPROM.h - A persistent sample log in the EEPROM of the
+ * Atmega328P. The records are stored in the compact format of
+ * BB_SAMPLELOG_CODEC.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+extern "C" {
+    #include <stdint.h>
+    #include <avr/io.h>
+    #include <avr/interrupt.h>
+    #include <avr/sleep.h>
+    #include <avr/eeprom.h>
+    #include <util/crc16.h>
+    #include <util/atomic.h>
+}
+
+#include "BB_SAMPLELOG_CODEC.h"
+
+#ifndef BB_SAMPLELOG_EEPROM_H_
+#define BB_SAMPLELOG_EEPROM_H_
+
+// EEPROM area of the log, behind the calibration cache of the BME280
+#ifndef BB_SAMPLELOG_EEPROM_ADDR
+    #define BB_SAMPLELOG_EEPROM_ADDR 0x0040
+#endif
+#ifndef BB_SAMPLELOG_EEPROM_SIZE
+    #define BB_SAMPLELOG_EEPROM_SIZE 0x03C0
+#endif
+
+// the log consists of pages, each page is written once per round
+#define BB_SAMPLELOG_EEPROM_PAGE_SIZE 64
+#define BB_SAMPLELOG_EEPROM_PAGES (BB_SAMPLELOG_EEPROM_SIZE / BB_SAMPLELOG_EEPROM_PAGE_SIZE)
+
+// header of a page: sequence (2 bytes), length of the data (1 byte),
+// CRC-16/XMODEM of BB_SAMPLELOG_CODEC_VERSION, sequence, length and data (2 bytes)
+#define BB_SAMPLELOG_EEPROM_HEADER_SIZE 5
+#define BB_SAMPLELOG_EEPROM_DATA_SIZE (BB_SAMPLELOG_EEPROM_PAGE_SIZE - BB_SAMPLELOG_EEPROM_HEADER_SIZE)
+
+#if BB_SAMPLELOG_EEPROM_DATA_SIZE < BB_SAMPLELOG_CODEC_MAX_SIZE
+    #error "BB_SAMPLELOG_EEPROM_PAGE_SIZE is too small for a keyframe"
+#endif
+
+// size of the header of a bulk read (number of bytes)
+#define BB_SAMPLELOG_EEPROM_STREAM_HEADER_SIZE 2
+// number of bytes of a bulk read while the EEPROM is busy, no records follow
+#define BB_SAMPLELOG_EEPROM_STREAM_BUSY 0xFFFF
+
+/**
+ * Objects of this class provide access to the log (there is only one).
+ * The records are collected in a page buffer in RAM, each page starts with
+ * a keyframe. A full page is written to the oldest page of the EEPROM - the
+ * pages are written one after the other in a circle, so all pages wear out
+ * equally. A page interrupted by a reset fails its CRC and is ignored.
+ * The records in the page buffer are lost on a reset.
+ *
+ * A page is written in the background, one byte per EEPROM ready interrupt
+ * (ISR(EE_READY_vect), 3.4 ms per changed byte, up to 220 ms per page).
+ * Other EEPROM accesses of the application have to wait until isWriting()
+ * returns 0. The EEPROM ready interrupt does not wake the controller from
+ * power-down, sleep in the idle mode while a page is written.
+ *
+ * The pages are read out with the stream functions, which are meant for
+ * BB_SPI::setStream(): a bulk read consists of the number of bytes (2 bytes,
+ * MSB first) followed by the encoded records of all pages which have not
+ * been read completely before, oldest first. While a page is written the
+ * number of bytes is BB_SAMPLELOG_EEPROM_STREAM_BUSY and no records follow.
+ * The position of the read out is kept in RAM only: after a reset all pages
+ * are sent again, the master drops the records it knows by their sequence.
+ */
+class BB_SAMPLELOG_EEPROM{
+
+	public:
+	    /**
+	     * Initializes a BB_SAMPLELOG_EEPROM object. The pages are scanned,
+	     * the log continues behind the newest valid page.
+	     */
+	    BB_SAMPLELOG_EEPROM();
+
+	    /**
+	     * Appends a record. A full page is written to the EEPROM in the
+	     * background. If the page before is still being written, this waits
+	     * for it (idle sleep).
+	     * @param record the sample
+	     * @return 1 if the record was stored, -1 if it was dropped (bulk read running)
+	     */
+	    int8_t append(const BB_SAMPLELOG_RECORD &record);
+
+	    /**
+	     * Writes the records of the page buffer to the EEPROM, e.g. before a
+	     * planned power off. The page is written in the background, see isWriting().
+	     * @return 1 if successful, -1 if a bulk read is running
+	     */
+	    int8_t flush(void);
+
+	    /**
+	     * Reads the newest record of the EEPROM, e.g. to continue the sequence
+	     * after a reset.
+	     * @param record the newest record after the call
+	     * @return 1 if successful, -1 if there is no valid page or a bulk read is running
+	     */
+	    int8_t readLast(BB_SAMPLELOG_RECORD &record);
+
+	    /**
+	     * Checks if a page is being written in the background.
+	     * @return 1 while a page is written, 0 otherwise
+	     */
+	    static uint8_t isWriting(void);
+
+	    /**
+	     * Provides the number of valid pages in the EEPROM.
+	     * @return the number of pages
+	     */
+	    uint8_t getPages(void);
+
+	    /**
+	     * Starts a bulk read of the pages not read before. The bulk read is
+	     * busy (BB_SAMPLELOG_EEPROM_STREAM_BUSY) while a page is written or the
+	     * main context accesses the EEPROM (append(), flush(), readLast()),
+	     * those are refused while a bulk read is running.
+	     * @return the number of bytes of the bulk read
+	     */
+	    static uint16_t streamBegin(void);
+
+	    /**
+	     * Provides the next byte of the bulk read.
+	     * @return the byte
+	     */
+	    static uint8_t streamNext(void);
+
+	    /**
+	     * Completes the bulk read.
+	     * @param complete 1 if all bytes were read - the pages are not sent again,
+	     *        0 if the bulk read was aborted
+	     */
+	    static void streamEnd(uint8_t complete);
+};
+
+#endif /* BB_SAMPLELOG_EEPROM_H_ */
@@ -0,0 +1,234 @@
+/*
+ * BB_SPI.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include "BB_SPI.h"
+
+// state of the ISR (there is only one SPI)
+
+// the registered responses, _streams[n] is 0 for a buffer
+static uint8_t _commands[BB_SPI_MAX_RESPONSES];
+static const volatile uint8_t *_responses[BB_SPI_MAX_RESPONSES];
+static const BB_SPI_STREAM *_streams[BB_SPI_MAX_RESPONSES];
+static uint8_t _lengths[BB_SPI_MAX_RESPONSES];
+static volatile uint8_t _responseCount = 0;
+
+// the commands followed by arguments
+static uint8_t _argCommands[BB_SPI_MAX_ARGUMENTS];
+static uint8_t _argCounts[BB_SPI_MAX_ARGUMENTS];
+static volatile uint8_t _argCommandCount = 0;
+// number of received bytes still to be buffered as arguments
+static volatile uint8_t _rxArguments = 0;
+
+// the running response
+static const volatile uint8_t *_txData;
+static const BB_SPI_STREAM *_txStream;
+static volatile uint16_t _txIndex = 0;
+static volatile uint16_t _txLength = 0;
+// number of received bytes still belonging to the running response
+static volatile uint16_t _txPending = 0;
+
+// ring buffer of the received bytes
+static volatile uint8_t _rxBuffer[BB_SPI_RX_SIZE];
+static volatile uint8_t _rxHead = 0;
+static volatile uint8_t _rxCount = 0;
+
+/**
+ * Provides the next byte of the running response.
+ */
+static inline uint8_t _txNext(void){
+	if (_txIndex >= _txLength) return BB_SPI_IDLE_BYTE;
+	_txIndex++;
+	return (_txStream) ? _txStream->next() : _txData[_txIndex - 1];
+}
+
+/**
+ * Buffers a received byte.
+ */
+static inline void _rxPush(uint8_t received){
+	if (_rxCount < BB_SPI_RX_SIZE){
+		_rxBuffer[(_rxHead + _rxCount) & (BB_SPI_RX_SIZE - 1)] = received;
+		_rxCount++;
+	}
+}
+
+ISR(SPI_STC_vect){
+	uint8_t received = SPDR;
+	uint8_t n;
+
+	if (_txPending > 0){
+		// the master clocked out one byte of the response -> load the next one
+		SPDR = _txNext();
+		_txPending--;
+		if ((_txPending == 0) && _txStream && _txStream->end) _txStream->end(1);
+		return;
+	}
+
+	if (_rxArguments > 0){
+		// arguments are never interpreted as commands
+		SPDR = BB_SPI_IDLE_BYTE;
+		_rxArguments--;
+		_rxPush(received);
+		return;
+	}
+
+	for (n = 0; n < _responseCount; n++){
+		if (_commands[n] == received){
+			// start the response, the master clocks it out with the next bytes
+			_txData = _responses[n];
+			_txStream = _streams[n];
+			_txLength = (_txStream) ? _txStream->begin() : _lengths[n];
+			_txIndex = 0;
+			SPDR = _txNext();
+			_txPending = _txLength;
+			return;
+		}
+	}
+
+	SPDR = BB_SPI_IDLE_BYTE;
+	for (n = 0; n < _argCommandCount; n++){
+		if (_argCommands[n] == received){
+			_rxArguments = _argCounts[n];
+			break;
+		}
+	}
+	_rxPush(received);
+}
+
+/**
+ * Finds the entry of a command in the response table.
+ * @return the index, _responseCount for a new command
+ */
+static uint8_t _findResponse(uint8_t command){
+	uint8_t n;
+	for (n = 0; n < _responseCount; n++){
+		if (_commands[n] == command) break;
+	}
+	return n;
+}
+
+BB_SPI::BB_SPI(){
+	volatile uint8_t dummy;
+
+	// Set PB4(MISO) as output - all others are input
+	DDRB |= (1 << PB4);
+
+	// Enable SPI in Slave Mode with interrupt
+	SPCR = (1 << SPE) | (1 << SPIE);
+
+	dummy = SPSR;                         // Clear SPIF bit in SPSR
+	dummy = SPDR;
+	(void) dummy;
+	SPDR = BB_SPI_IDLE_BYTE;
+}
+
+int8_t BB_SPI::setResponse(uint8_t command, const volatile uint8_t *data, uint8_t len){
+	int8_t r_val = -1;
+	uint8_t n;
+
+	if (len == 0) return r_val;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		n = _findResponse(command);
+		if (n < BB_SPI_MAX_RESPONSES){
+			_commands[n] = command;
+			_responses[n] = data;
+			_streams[n] = 0;
+			_lengths[n] = len;
+			if (n == _responseCount) _responseCount++;
+			r_val = 1;
+		}
+	}
+	return r_val;
+}
+
+int8_t BB_SPI::setStream(uint8_t command, const BB_SPI_STREAM *stream){
+	int8_t r_val = -1;
+	uint8_t n;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		n = _findResponse(command);
+		if (n < BB_SPI_MAX_RESPONSES){
+			_commands[n] = command;
+			_responses[n] = 0;
+			_streams[n] = stream;
+			_lengths[n] = 0;
+			if (n == _responseCount) _responseCount++;
+			r_val = 1;
+		}
+	}
+	return r_val;
+}
+
+int8_t BB_SPI::setArgumentCount(uint8_t command, uint8_t count){
+	int8_t r_val = -1;
+	uint8_t n;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		for (n = 0; n < _argCommandCount; n++){
+			if (_argCommands[n] == command) break;
+		}
+		if (n < BB_SPI_MAX_ARGUMENTS){
+			_argCommands[n] = command;
+			_argCounts[n] = count;
+			if (n == _argCommandCount) _argCommandCount++;
+			r_val = 1;
+		}
+	}
+	return r_val;
+}
+
+int16_t BB_SPI::read(void){
+	int16_t r_val = -1;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if (_rxCount > 0){
+			r_val = _rxBuffer[_rxHead];
+			_rxHead = (_rxHead + 1) & (BB_SPI_RX_SIZE - 1);
+			_rxCount--;
+		}
+	}
+	return r_val;
+}
+
+uint8_t BB_SPI::available(void){
+	return _rxCount;
+}
+
+uint8_t BB_SPI::isSending(const volatile uint8_t *data){
+	uint8_t r_val = 0;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if ((_txPending > 0) && !_txStream && (_txData == data)) r_val = 1;
+	}
+	return r_val;
+}
+
+void BB_SPI::reset(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if ((_txPending > 0) && _txStream && _txStream->end) _txStream->end(0);
+		_txPending = 0;
+		_txLength = 0;
+		_rxArguments = 0;
+		SPDR = BB_SPI_IDLE_BYTE;
+	}
+}
+
+void BB_SPI_storeU32(volatile uint8_t *data, uint32_t value){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		data[0] = (uint8_t) (value >> 24);
+		data[1] = (uint8_t) (value >> 16);
+		data[2] = (uint8_t) (value >> 8);
+		data[3] = (uint8_t) value;
+	}
+}
+
+void BB_SPI_storeU16(volatile uint8_t *data, uint16_t value){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		data[0] = (uint8_t) (value >> 8);
+		data[1] = (uint8_t) value;
+	}
+}
@@ -0,0 +1,138 @@
+/**
+ * BB_SPI.h - A library providing interrupt driven SPI functionality for SPI slaves.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ *  Released into the public domain.
+ */
+
+extern "C" {
+    #include <avr/io.h>
+    #include <stdint.h>
+    #include <util/atomic.h>
+    #include <avr/interrupt.h>
+}
+
+#ifndef BB_SPI_H_
+#define BB_SPI_H_
+
+// number of commands with a registered response or stream
+#ifndef BB_SPI_MAX_RESPONSES
+    #define BB_SPI_MAX_RESPONSES 16
+#endif
+
+// size of the buffer for received command bytes (power of 2)
+#ifndef BB_SPI_RX_SIZE
+    #define BB_SPI_RX_SIZE 8
+#endif
+
+// number of commands followed by arguments
+#ifndef BB_SPI_MAX_ARGUMENTS
+    #define BB_SPI_MAX_ARGUMENTS 4
+#endif
+
+// the byte shifted out when there is no response
+#define BB_SPI_IDLE_BYTE 0xFF
+
+// minimum gap between two bytes the master has to keep, the ISR needs this
+// time to load the next byte (F_CPU = 8 MHz)
+#define BB_SPI_MIN_BYTE_GAP_US 30
+
+/**
+ * A response which is generated byte by byte in the ISR, e.g. from a ring buffer.
+ * The functions are called from ISR(SPI_STC_vect) and have to be short.
+ */
+typedef struct{
+	uint16_t (*begin)(void); // called when the command is received, returns the length of the response
+	uint8_t (*next)(void);   // provides the next byte of the response
+	void (*end)(uint8_t complete); // called with 1 when the master clocked out the complete response,
+	                               // with 0 when the response was aborted by reset(), may be 0
+} BB_SPI_STREAM;
+
+/**
+ * Objects of this class are used for communication using the SPI protocol.
+ * This is for a SPI slave. All bytes are handled in ISR(SPI_STC_vect):
+ * a command with a registered response is answered by the ISR without any
+ * involvement of the main loop - each following byte from the master shifts
+ * out the next byte of the response. All other bytes are buffered and
+ * fetched with read().
+ */
+class BB_SPI{
+
+	public:
+	    /**
+	     * Initiates the SPI in slave mode with interrupts.
+	     * MISO (PB4) is set to output.
+	     */
+	    BB_SPI();
+
+	    /**
+	     * Registers the response to a command. When the command is received,
+	     * the ISR shifts out len bytes of data with the next len bytes the master
+	     * sends. The data is read in the ISR, so it has to stay valid and has to
+	     * be modified in an ATOMIC_BLOCK only.
+	     * @param command the command byte
+	     * @param data the response
+	     * @param len the number of bytes of the response. Has to be > 0.
+	     * @return 1 if successful, -1 if BB_SPI_MAX_RESPONSES responses are registered already
+	     */
+	    int8_t setResponse(uint8_t command, const volatile uint8_t *data, uint8_t len);
+
+	    /**
+	     * Registers a response which is generated in the ISR.
+	     * @param command the command byte
+	     * @param stream the functions providing the response
+	     * @return 1 if successful, -1 if BB_SPI_MAX_RESPONSES responses are registered already
+	     */
+	    int8_t setStream(uint8_t command, const BB_SPI_STREAM *stream);
+
+	    /**
+	     * Registers a command which is followed by arguments. The arguments are
+	     * buffered like the command and are never taken as a command, even if
+	     * they have the value of one.
+	     * @param command the command byte
+	     * @param count the number of argument bytes following the command
+	     * @return 1 if successful, -1 if BB_SPI_MAX_ARGUMENTS commands are registered already
+	     */
+	    int8_t setArgumentCount(uint8_t command, uint8_t count);
+
+	    /**
+	     * Provides the next received byte without a registered response.
+	     * @return the received byte or -1 if there is none
+	     */
+	    int16_t read(void);
+
+	    /**
+	     * Checks if there are received bytes which have not been read.
+	     * @return the number of bytes which can be fetched with read()
+	     */
+	    uint8_t available(void);
+
+	    /**
+	     * Checks if a running response sends a buffer. A response keeps the
+	     * buffer it started with, even if setResponse() replaces it meanwhile.
+	     * @param data the response buffer
+	     * @return 1 if the buffer is being sent, 0 otherwise
+	     */
+	    uint8_t isSending(const volatile uint8_t *data);
+
+	    /**
+	     * Aborts a running response and pending arguments. Received bytes are kept.
+	     * Can be called from an ISR, e.g. when SS goes high.
+	     */
+	    static void reset(void);
+};
+
+/**
+ * Stores a value as 4 bytes (MSB first) in a response buffer.
+ * Interrupts are disabled while writing.
+ */
+void BB_SPI_storeU32(volatile uint8_t *data, uint32_t value);
+
+/**
+ * Stores a value as 2 bytes (MSB first) in a response buffer.
+ * Interrupts are disabled while writing.
+ */
+void BB_SPI_storeU16(volatile uint8_t *data, uint16_t value);
+
+#endif /* BB_SPI_H_ */
@@ -0,0 +1,158 @@
+/**
+ * Let an UnoEVS sample autonomously and collect the samples in one bulk read.
+ * The UnoEVS wakes up by its watchdog, takes a sample and stores it in its
+ * sample log. The master only wakes it up to fetch all samples at once.
+ *
+ * v0.01 created 19. Oct. 2016
+ * by Engelbert Mittermeier (BlueberryE GmbH)
+ *
+ * The samples are transferred in a compact format. The decoder is part of
+ * the BB_SAMPLELOG library - copy Libraries/BB_SAMPLELOG to the Arduino
+ * libraries folder.
+ *
+ * The UnoEVS keeps the position of the EEPROM read out in RAM only: after a
+ * reset of the UnoEVS all EEPROM pages are sent again, and the RAM log may
+ * contain samples which were read from the EEPROM before. The master drops
+ * the samples it knows by their sequence number.
+ */
+
+#include <BB_SAMPLELOG_CODEC.h>
+
+// gap between two SPI bytes in us, BB_SPI_MIN_BYTE_GAP_US in
+// Libraries/BB_SPI/BB_SPI.h (not included, it is the slave side)
+const uint16_t spiByteGap = 30;
+
+// The following two functions are used for SPI communication
+// This can easily be replaced by the SPI.h library
+
+// initialize the SPI as master
+// fosc/16 -> 1MHz, the UnoEVS (8MHz) accepts up to 2MHz
+void my_Spi_init(){
+  pinMode(SS, OUTPUT);
+  SPCR |= _BV(MSTR);
+  SPCR |= _BV(SPE);
+  SPCR |= _BV(SPR0);
+  pinMode(SCK, OUTPUT);
+  pinMode(MOSI, OUTPUT);
+}
+
+// used for data transfer (read and write)
+// the UnoEVS loads the next response byte in its SPI interrupt - this needs
+// a gap of spiByteGap between two bytes
+uint8_t my_Spi_transfer(uint8_t inData){
+  delayMicroseconds(spiByteGap);
+  SPDR = inData;
+    while (!(SPSR & _BV(SPIF))) ; // wait
+    return SPDR;
+}
+
+
+// Define commands:
+
+// set the UnoEVS to sleep mode
+const uint8_t cmdSleep = 0xF0;
+
+// commands for the sample log:
+// start autonomous sampling, followed by the period in s (1 .. 255)
+const uint8_t cmdLogStart = 0x50;
+// stop autonomous sampling
+const uint8_t cmdLogStop = 0x51;
+// read all samples: number of bytes (2 bytes), then the encoded records
+const uint8_t cmdLogRead = 0x52;
+// read the samples of the EEPROM not read before (same format), they survive
+// a reset of the UnoEVS
+const uint8_t cmdEepromLogRead = 0x53;
+// number of bytes of an EEPROM bulk read while the UnoEVS writes a page
+// (BB_SAMPLELOG_EEPROM_STREAM_BUSY), no records follow
+const uint16_t logBusy = 0xFFFF;
+// waiting time before asking again, a page is written within 220 ms
+const uint16_t busyWait = 50;
+
+// the sampling period of the UnoEVS in s
+const uint8_t samplePeriod = 10;
+// the master collects the samples every 5 minutes
+const unsigned long collectPeriod = 300000UL;
+
+// waiting time for the wake up of the UnoEVS
+const uint16_t waitTime = 10;
+
+// the encoded records, the UnoEVS stores up to 640 bytes in RAM and
+// 885 bytes in the EEPROM
+uint8_t logData[900];
+
+// the sequence of the newest sample received
+uint16_t lastSequence;
+bool lastValid = false;
+
+void setup() {
+  Serial.begin(9600);
+  digitalWrite(SS, HIGH);
+  my_Spi_init();
+  delay(waitTime);
+  digitalWrite(SS, LOW);
+  delay(waitTime);
+  // the samples taken before the master was started
+  Serial.println("Backlog:");
+  readLog(cmdEepromLogRead);
+  my_Spi_transfer(cmdLogStart);
+  my_Spi_transfer(samplePeriod);
+  my_Spi_transfer(cmdSleep);
+  digitalWrite(SS, HIGH);
+  Serial.println("Setup completed");
+}
+
+void loop() {
+    delay(collectPeriod); // the master may sleep here
+
+    digitalWrite(SS, LOW); // select the UnoEVS + wake up
+    delay(waitTime);
+
+    readLog(cmdLogRead);
+
+    my_Spi_transfer(cmdSleep); // set the UnoEVS to sleep, it continues sampling
+
+    digitalWrite(SS, HIGH);
+}
+
+/**
+ * Fetches samples in one bulk read and prints them.
+ * @param cmd the command of the bulk read
+ */
+void readLog(uint8_t cmd){
+    uint16_t len;
+    uint16_t pos = 0;
+    uint8_t n;
+    BB_SAMPLELOG_RECORD record;
+
+    do {
+        my_Spi_transfer(cmd);
+        len = (uint16_t) my_Spi_transfer(0xFF) << 8;
+        len |= my_Spi_transfer(0xFF);
+        if (len == logBusy) delay(busyWait);
+    } while (len == logBusy);
+    for (uint16_t i = 0; i < len; i++){
+        uint8_t data = my_Spi_transfer(0xFF);
+        if (i < sizeof(logData)) logData[i] = data;
+    }
+
+    // decode the records, the first one is a keyframe
+    if (len > sizeof(logData)) len = sizeof(logData);
+    while ((n = BB_SAMPLELOG_decode(&logData[pos], len - pos, record)) > 0){
+        pos += n;
+
+        // drop the samples received before (modulo 65536)
+        if (lastValid && ((int16_t) (record.sequence - lastSequence) <= 0)) continue;
+        lastSequence = record.sequence;
+        lastValid = true;
+
+        // print out the data or do some other stuff:
+        Serial.print("#"); Serial.print(record.sequence);
+        Serial.print(" T = "); Serial.print(record.temperature / 100.0);
+        Serial.print(" P = "); Serial.print(record.pressure / 100.0);
+        Serial.print(" H = "); Serial.print(record.humidity / 100.0);
+        Serial.print(" E = "); Serial.print(record.lux / 100.0);
+        Serial.print(" UV = "); Serial.print(record.uvLevel);
+        Serial.print(" Vcc = "); Serial.print(record.supply);
+        Serial.print(" Tmcu = "); Serial.println(record.mcuTemperature / 10.0);
+    }
+}
@@ -5,22 +5,31 @@
  * by Engelbert Mittermeier (BlueberryE GmbH)
  */
 
+#include <util/crc16.h>
+
+// gap between two SPI bytes in us, BB_SPI_MIN_BYTE_GAP_US in
+// Libraries/BB_SPI/BB_SPI.h (not included, it is the slave side)
+const uint16_t spiByteGap = 30;
+
 // The following two functions are used for SPI communication
 // This can easily be replaced by the SPI.h library
 
 // initialize the SPI as master
+// fosc/16 -> 1MHz, the UnoEVS (8MHz) accepts up to 2MHz
 void my_Spi_init(){
   pinMode(SS, OUTPUT);
   SPCR |= _BV(MSTR);
   SPCR |= _BV(SPE);
-  SPCR |= _BV(SPR1);
   SPCR |= _BV(SPR0);
   pinMode(SCK, OUTPUT);
   pinMode(MOSI, OUTPUT);
 }
 
 // used for data transfer (read and write)
+// the UnoEVS loads the next response byte in its SPI interrupt - this needs
+// a gap of spiByteGap between two bytes
 uint8_t my_Spi_transfer(uint8_t inData){
+  delayMicroseconds(spiByteGap);
   SPDR = inData;
     while (!(SPSR & _BV(SPIF))) ; // wait
     return SPDR;
@@ -49,30 +58,57 @@ const uint8_t cmdLtrStart = 0x20;
 const uint8_t cmdLtrGetCh0 = 0x21;
 // get the value from channel 0
 const uint8_t cmdLtrGetCh1 = 0x22;
+// get the illuminance (4 bytes, 0.01 lx)
+const uint8_t cmdLtrGetLux = 0x23;
 
 // commands for the ML8511 (UV):
 // trigger the measurements
 const uint8_t cmdMl8511Start = 0x30;
 // get the value from the sensor
 const uint8_t cmdMl8511GetValue = 0x31;
+// get UV intensity (2 bytes, 0.01 mW/cm2) and UV index (2 bytes, 0.1)
+const uint8_t cmdMl8511GetUv = 0x33;
+
+// commands for all sensors:
+// trigger the measurements of all sensors
+const uint8_t cmdMeasureAll = 0x40;
+// get all values in one frame
+const uint8_t cmdGetFrame = 0x41;
+
+// commands for the controller itself:
+// measure supply voltage and controller temperature
+const uint8_t cmdAdcStart = 0x70;
+// get the supply voltage (2 bytes, mV)
+const uint8_t cmdAdcGetSupplyVoltage = 0x71;
+// get the controller temperature (2 bytes, 0.1 degC)
+const uint8_t cmdAdcGetTemperature = 0x72;
+
+// layout of the frame, all values MSB first
+const uint8_t frameTemperature = 0;  // 4 bytes, 0.01 degC
+const uint8_t framePressure = 4;     // 4 bytes, Pa
+const uint8_t frameHumidity = 8;     // 4 bytes, 1/1024 %RH
+const uint8_t frameLux = 12;         // 4 bytes, 0.01 lx
+const uint8_t frameUv = 16;          // 2 bytes
+const uint8_t frameSupply = 18;      // 2 bytes, mV
+const uint8_t frameMcuTemperature = 20; // 2 bytes, 0.1 degC
+const uint8_t frameStatus = 22;      // 1 byte
+const uint8_t frameSequence = 23;    // 2 bytes
+const uint8_t frameCrc = 25;         // 2 bytes, CRC-16/XMODEM of the bytes 0 .. 24
+const uint8_t frameStatusBusy = 0x80; // the measurement was not finished yet
 
 
 // Define variables taking the measurement data:
-// variables for the bme280
-uint8_t bmeTemperature[4]; // the temperature value consists of 4 bytes
-uint8_t bmePressure[4];    // the pressure value consists of 4 bytes
-uint8_t bmeHumidity[4];    // the humidity value consists of 4 bytes
-
-// variables for the ltr303als01 (visible light)
-uint8_t ltrVisibleCh0[2];  // the value from channel 0 consists of 2 bytes
-uint8_t ltrVisibleCh1[2];  // the value from channel 1 consists of 2 bytes
-
-// variable for the ml8511 (uv)
-uint8_t ml8511Value[2];    // the value from the ml8511
-
-// waiting times: time for wake up, sensor measurement time, calculation time, ...
-const uint16_t waitTime = 10;
-const uint16_t waitTimeMl8511 = 200; //10ms is too less -> the ml8511 waits 100ms before reading the data
+uint8_t frame[27]; // all values
+uint8_t uv[4]; // UV intensity and UV index
+
+// waiting times: time for wake up and sensor measurement time
+// there is no need to wait for the responses - they are sent from a buffer
+const uint16_t waitTime = 10; // wake up from power down
+const uint16_t waitTimeBme = 15; // forced mode conversion: max. 9.3ms (weather monitoring settings)
+const uint16_t waitTimeLtr = 2; // reading the channels via I2C
+const uint16_t waitTimeMl8511 = 40; // the ml8511 settles (a few ms, at most 20ms), then 3 conversions
+const uint16_t waitTimeMcu = 45; // supply voltage, controller temperature (the reference settles twice)
+const uint16_t waitTimeAll = waitTimeMl8511 + waitTimeMcu; // the sensors measure at the same time, the ADC measures the MCU after the ML8511
 
 void setup() {
   Serial.begin(9600);
@@ -85,75 +121,47 @@ void setup() {
 }
 
 void loop() {
-    
-    // Trigger BME280 meaurements and get data:
-    
-    digitalWrite(SS, LOW); // select the UnoEVS + wake up
-    delay(waitTime);
+    uint16_t crc = 0;
 
-    // trigger the bme280 measurements
-    my_Spi_transfer(cmdBmeStart);
-    delay(waitTime);
-          
-    // fetch the bme280 data from the EVS
-    my_Spi_transfer(cmdBmeGetTemperature);
-    for (unsigned int i = 0; i < sizeof(bmeTemperature); i++) bmeTemperature[i] = my_Spi_transfer(0xFF);
-    my_Spi_transfer(cmdBmeGetPressure);
-    for (unsigned int i = 0; i < sizeof(bmeTemperature); i++) bmePressure[i] = my_Spi_transfer(0xFF);
-    my_Spi_transfer(cmdBmeGetHumidity);
-    for (unsigned int i = 0; i < sizeof(bmeTemperature); i++) bmeHumidity[i] = my_Spi_transfer(0xFF);
-
-    my_Spi_transfer(cmdSleep); // set the UnoEVS to sleep
-                
-    digitalWrite(SS, HIGH); 
-               
-    // print out the data or do some other stuff:
-    Serial.print("T = "); Serial.print(convertArray(bmeTemperature, 4, 1.0 / 100.0)); Serial.println("degC");
-    Serial.print("P = "); Serial.print(convertArray(bmePressure, 4, 1.0 / 100.0)); Serial.println("hPa");
-    Serial.print("H = "); Serial.print(convertArray(bmeHumidity, 4, 1.0 / 1024.0)); Serial.println("%");
-
-    // Trigger LTR303ALS01 (visible light) meaurements and get data:
+    // Trigger the measurements of all sensors and get all data in one frame:
 
     digitalWrite(SS, LOW); // select the UnoEVS + wake up
     delay(waitTime);
 
-    // trigger the ltr303als01 measurements
-    my_Spi_transfer(cmdLtrStart);
-    delay(waitTime);
-
-    // fetch the ltr303als01 data from the EVS
-    my_Spi_transfer(cmdLtrGetCh0);
-    for (unsigned int i = 0; i < sizeof(ltrVisibleCh0); i++) ltrVisibleCh0[i] = my_Spi_transfer(0xFF);
-    my_Spi_transfer(cmdLtrGetCh1);
-    for (unsigned int i = 0; i < sizeof(ltrVisibleCh1); i++) ltrVisibleCh1[i] = my_Spi_transfer(0xFF);
-                
-    my_Spi_transfer(cmdSleep); // set the UnoEVS to sleep
-                
-    digitalWrite(SS, HIGH); 
-               
-    // print out the data or do some other stuff:
-    Serial.print("CH0 = "); Serial.println(convertArray(ltrVisibleCh0, 2, 1.0));
-    Serial.print("CH1 = "); Serial.println(convertArray(ltrVisibleCh1, 2, 1.0));
-                   
-    // Trigger ML8511 (UV) meaurements and get data:
+    // trigger the measurements
+    my_Spi_transfer(cmdMeasureAll);
+    delay(waitTimeAll);
 
-    digitalWrite(SS, LOW); // select the UnoEVS + wake up
-    delay(waitTime);
+    // fetch the frame from the EVS, ask again if the measurement is still running
+    do {
+        my_Spi_transfer(cmdGetFrame);
+        for (unsigned int i = 0; i < sizeof(frame); i++) frame[i] = my_Spi_transfer(0xFF);
+    } while (frame[frameStatus] & frameStatusBusy);
 
-    // trigger the ml8511 measurements
-    my_Spi_transfer(cmdMl8511Start);
-    delay(waitTimeMl8511);
+    my_Spi_transfer(cmdMl8511GetUv);
+    for (unsigned int i = 0; i < sizeof(uv); i++) uv[i] = my_Spi_transfer(0xFF);
 
-    // fetch the ml8511 data from the EVS
-    my_Spi_transfer(cmdMl8511GetValue);
-    for (unsigned int i = 0; i < sizeof(ml8511Value); i++) ml8511Value[i] = my_Spi_transfer(0xFF);
-    
     my_Spi_transfer(cmdSleep); // set the UnoEVS to sleep
-                
-    digitalWrite(SS, HIGH); 
-                
-    // print out the data or do some other stuff:
-    Serial.print("UV = "); Serial.println(convertArray(ml8511Value, 2, 1.0));
+
+    digitalWrite(SS, HIGH);
+
+    for (unsigned int i = 0; i < frameCrc; i++) crc = _crc_xmodem_update(crc, frame[i]);
+    if (crc != convertArray(&frame[frameCrc], 2, 1.0)){
+        Serial.println("CRC error");
+    } else {
+        // print out the data or do some other stuff:
+        Serial.print("#"); Serial.print(convertArray(&frame[frameSequence], 2, 1.0), 0);
+        Serial.print(" status = 0x"); Serial.println(frame[frameStatus], HEX);
+        Serial.print("T = "); Serial.print(convertArray(&frame[frameTemperature], 4, 1.0 / 100.0)); Serial.println("degC");
+        Serial.print("P = "); Serial.print(convertArray(&frame[framePressure], 4, 1.0 / 100.0)); Serial.println("hPa");
+        Serial.print("H = "); Serial.print(convertArray(&frame[frameHumidity], 4, 1.0 / 1024.0)); Serial.println("%");
+        Serial.print("E = "); Serial.print(convertArray(&frame[frameLux], 4, 1.0 / 100.0)); Serial.println("lx");
+        Serial.print("UV = "); Serial.println(convertArray(&frame[frameUv], 2, 1.0));
+        Serial.print("Vcc = "); Serial.print(convertArray(&frame[frameSupply], 2, 1.0), 0); Serial.println("mV");
+        Serial.print("Tmcu = "); Serial.print((int16_t) (uint16_t) convertArray(&frame[frameMcuTemperature], 2, 1.0) / 10.0); Serial.println("degC");
+        Serial.print("UV intensity = "); Serial.print(convertArray(&uv[0], 2, 1.0 / 100.0)); Serial.println("mW/cm2");
+        Serial.print("UV index = "); Serial.println(convertArray(&uv[2], 2, 1.0 / 10.0), 1);
+    }
 
     Serial.println("--------------------------------");
     delay(2000); // wait 2 s before the next cycle
@@ -0,0 +1,323 @@
+/*
+ * BB_BME280_COMPENSATION_TEST.cpp - Host test of the BME280 compensation.
+ * Sweeps the ADC space and compares the library with the reference formulas
+ * of the datasheet (chapter 8.2): bit-identical to the 32 bit integer
+ * formulas, within the rounding of the 64 bit pressure formula and the
+ * floating point humidity formula. Checks the conversion of the calibration
+ * registers (signed 12 bit dig_H4 / dig_H5). Measures the time per sample of
+ * the library and of the 32 bit reference.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "BB_BME280_COMPENSATION.h"
+
+// step widths of the sweep (20 bit temperature and pressure, 16 bit humidity)
+#define SWEEP_STEP_T 257
+#define SWEEP_STEP_P 4099
+#define SWEEP_STEP_H 257
+
+// operating range in which the 64 bit pressure formula is compared
+#define RANGE_T_MIN -4000      // degC * 100
+#define RANGE_T_MAX 8500
+#define RANGE_P_MIN 30000      // Pa
+#define RANGE_P_MAX 110000
+#define RANGE_H_MIN 1          // %RH
+#define RANGE_H_MAX 99
+// largest accepted difference to the floating point humidity formula
+#define RANGE_H_DIFF 0.1       // %RH
+
+// samples per calibration and number of runs of the benchmark
+#define BENCH_SAMPLES 65536
+#define BENCH_RUNS 20
+
+/**
+ * Calibration values of typical sensors.
+ */
+static const BB_BME280_CALIBRATION calibrations[] = {
+	{27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+	 75, 362, 0, 313, 50, 30},
+	{28485, 26735, 50, 37926, -10780, 3024, 5941, -35, -7, 9900, -10230, 4285,
+	 75, 359, 0, 335, 0, 30},
+	{27936, 26726, 50, 35456, -10422, 3024, 7910, -155, -7, 12300, -12000, 5000,
+	 75, 370, 0, 302, 50, 30},
+};
+
+#define CALIBRATIONS (sizeof(calibrations) / sizeof(calibrations[0]))
+
+/**
+ * Calibration registers with dig_H3 != 0 and negative dig_H4 / dig_H5:
+ * dig_H4 = -300 (0xED4), dig_H5 = -50 (0xFCE), the values of registersCalibration.
+ */
+static const uint8_t registersTp[BB_BME280_CALIBRATION_TP_SIZE] = {
+	0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC,               // dig_T1 .. dig_T3
+	0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27, 0x0B,   // dig_P1 .. dig_P4
+	0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6,   // dig_P5 .. dig_P8
+	0x70, 0x17,                                       // dig_P9
+	0x00, 0x4B                                        // reserved, dig_H1
+};
+static const uint8_t registersH[BB_BME280_CALIBRATION_H_SIZE] = {
+	0x6A, 0x01, 0x19, 0xED, 0xE4, 0xFC, 0x1E          // dig_H2 .. dig_H6
+};
+static const BB_BME280_CALIBRATION registersCalibration =
+	{27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+	 75, 362, 25, -300, -50, 30};
+
+// reference formulas, copied from the datasheet
+
+__attribute__((noinline))
+static int32_t referenceTemperature(const BB_BME280_CALIBRATION &c, int32_t adc_T, int32_t &t_fine){
+	int32_t var1, var2;
+
+	var1 = ((((adc_T >> 3) - ((int32_t) c.dig_T1 << 1))) * ((int32_t) c.dig_T2)) >> 11;
+	var2 = (((((adc_T >> 4) - ((int32_t) c.dig_T1)) * ((adc_T >> 4) - ((int32_t) c.dig_T1))) >> 12) *
+	        ((int32_t) c.dig_T3)) >> 14;
+	t_fine = var1 + var2;
+	return (t_fine * 5 + 128) >> 8;
+}
+
+__attribute__((noinline))
+static uint32_t referencePressure32(const BB_BME280_CALIBRATION &c, int32_t adc_P, int32_t t_fine){
+	int32_t var1, var2;
+	uint32_t p;
+
+	var1 = (((int32_t) t_fine) >> 1) - (int32_t) 64000;
+	var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t) c.dig_P6);
+	var2 = var2 + ((var1 * ((int32_t) c.dig_P5)) << 1);
+	var2 = (var2 >> 2) + (((int32_t) c.dig_P4) << 16);
+	var1 = (((c.dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t) c.dig_P2) * var1) >> 1)) >> 18;
+	var1 = ((((32768 + var1)) * ((int32_t) c.dig_P1)) >> 15);
+	if (var1 == 0) return 0;
+	p = (((uint32_t) (((int32_t) 1048576) - adc_P) - (var2 >> 12))) * 3125;
+	if (p < 0x80000000){
+		p = (p << 1) / ((uint32_t) var1);
+	} else {
+		p = (p / (uint32_t) var1) * 2;
+	}
+	var1 = (((int32_t) c.dig_P9) * ((int32_t) (((p >> 3) * (p >> 3)) >> 13))) >> 12;
+	var2 = (((int32_t) (p >> 2)) * ((int32_t) c.dig_P8)) >> 13;
+	p = (uint32_t) ((int32_t) p + ((var1 + var2 + c.dig_P7) >> 4));
+	return p;
+}
+
+// Pa * 256 (Q24.8)
+static uint32_t referencePressure64(const BB_BME280_CALIBRATION &c, int32_t adc_P, int32_t t_fine){
+	int64_t var1, var2, p;
+
+	var1 = ((int64_t) t_fine) - 128000;
+	var2 = var1 * var1 * (int64_t) c.dig_P6;
+	var2 = var2 + ((var1 * (int64_t) c.dig_P5) << 17);
+	var2 = var2 + (((int64_t) c.dig_P4) << 35);
+	var1 = ((var1 * var1 * (int64_t) c.dig_P3) >> 8) + ((var1 * (int64_t) c.dig_P2) << 12);
+	var1 = (((((int64_t) 1) << 47) + var1)) * ((int64_t) c.dig_P1) >> 33;
+	if (var1 == 0) return 0;
+	p = 1048576 - adc_P;
+	p = (((p << 31) - var2) * 3125) / var1;
+	var1 = (((int64_t) c.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+	var2 = (((int64_t) c.dig_P8) * p) >> 19;
+	p = ((p + var1 + var2) >> 8) + (((int64_t) c.dig_P7) << 4);
+	return (uint32_t) p;
+}
+
+// %RH
+static double referenceHumidityDouble(const BB_BME280_CALIBRATION &c, int32_t adc_H, int32_t t_fine){
+	double var_H;
+
+	var_H = ((double) t_fine) - 76800.0;
+	var_H = (adc_H - (((double) c.dig_H4) * 64.0 + ((double) c.dig_H5) / 16384.0 * var_H)) *
+	        (((double) c.dig_H2) / 65536.0 * (1.0 + ((double) c.dig_H6) / 67108864.0 * var_H *
+	                                          (1.0 + ((double) c.dig_H3) / 67108864.0 * var_H)));
+	var_H = var_H * (1.0 - ((double) c.dig_H1) * var_H / 524288.0);
+	if (var_H > 100.0) var_H = 100.0;
+	if (var_H < 0.0) var_H = 0.0;
+	return var_H;
+}
+
+__attribute__((noinline))
+static uint32_t referenceHumidity(const BB_BME280_CALIBRATION &c, int32_t adc_H, int32_t t_fine){
+	int32_t v_x1_u32r;
+
+	v_x1_u32r = (t_fine - ((int32_t) 76800));
+	v_x1_u32r = (((((adc_H << 14) - (((int32_t) c.dig_H4) << 20) - (((int32_t) c.dig_H5) * v_x1_u32r)) +
+	               ((int32_t) 16384)) >> 15) *
+	             (((((((v_x1_u32r * ((int32_t) c.dig_H6)) >> 10) *
+	                  (((v_x1_u32r * ((int32_t) c.dig_H3)) >> 11) + ((int32_t) 32768))) >> 10) +
+	                ((int32_t) 2097152)) * ((int32_t) c.dig_H2) + 8192) >> 14));
+	v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * ((int32_t) c.dig_H1)) >> 4));
+	v_x1_u32r = (v_x1_u32r < 0 ? 0 : v_x1_u32r);
+	v_x1_u32r = (v_x1_u32r > 419430400 ? 419430400 : v_x1_u32r);
+	return (uint32_t) (v_x1_u32r >> 12);
+}
+
+/**
+ * Sweeps the ADC space with one calibration.
+ * @param c the calibration values
+ * @param samples counts the compared values
+ * @param maxDiff64 the largest pressure difference to the 64 bit formula in Pa
+ * @param maxDiffH the largest humidity difference to the floating point formula in %RH
+ * @return the number of values differing from the 32 bit formulas
+ */
+static uint32_t sweep(const BB_BME280_CALIBRATION &c, uint32_t &samples, uint32_t &maxDiff64, double &maxDiffH){
+	BB_BME280_COEFFICIENTS coef;
+	uint32_t mismatches = 0;
+
+	BB_BME280_deriveCoefficients(c, coef);
+	for (int32_t adc_T = 0; adc_T < (1L << 20); adc_T += SWEEP_STEP_T){
+		int32_t t_fine, t_fineRef;
+		int32_t temperature = BB_BME280_compensateTemperature(c, coef, adc_T, t_fine);
+		int32_t temperatureRef = referenceTemperature(c, adc_T, t_fineRef);
+
+		samples++;
+		if ((temperature != temperatureRef) || (t_fine != t_fineRef)){
+			if (mismatches++ < 10) printf("  T mismatch adc_T=%ld: %ld != %ld\n",
+			                              (long) adc_T, (long) temperature, (long) temperatureRef);
+			continue;
+		}
+		uint8_t inRange = (temperature >= RANGE_T_MIN) && (temperature <= RANGE_T_MAX);
+
+		for (int32_t adc_P = 0; adc_P < (1L << 20); adc_P += SWEEP_STEP_P){
+			uint32_t pressure = BB_BME280_compensatePressure(c, coef, adc_P, t_fine);
+			uint32_t pressureRef = referencePressure32(c, adc_P, t_fine);
+
+			samples++;
+			if (pressure != pressureRef){
+				if (mismatches++ < 10) printf("  P mismatch adc_T=%ld adc_P=%ld: %lu != %lu\n",
+				                              (long) adc_T, (long) adc_P,
+				                              (unsigned long) pressure, (unsigned long) pressureRef);
+			}
+			if (inRange && (pressureRef >= RANGE_P_MIN) && (pressureRef <= RANGE_P_MAX)){
+				uint32_t pressure64 = (referencePressure64(c, adc_P, t_fine) + 128) >> 8;
+				uint32_t diff = (pressure > pressure64) ? pressure - pressure64 : pressure64 - pressure;
+				if (diff > maxDiff64) maxDiff64 = diff;
+			}
+		}
+		for (int32_t adc_H = 0; adc_H < (1L << 16); adc_H += SWEEP_STEP_H){
+			uint32_t humidity = BB_BME280_compensateHumidity(c, coef, adc_H, t_fine);
+			uint32_t humidityRef = referenceHumidity(c, adc_H, t_fine);
+
+			samples++;
+			if (humidity != humidityRef){
+				if (mismatches++ < 10) printf("  H mismatch adc_T=%ld adc_H=%ld: %lu != %lu\n",
+				                              (long) adc_T, (long) adc_H,
+				                              (unsigned long) humidity, (unsigned long) humidityRef);
+			}
+			double humidityDouble = referenceHumidityDouble(c, adc_H, t_fine);
+			if (inRange && (humidityDouble >= RANGE_H_MIN) && (humidityDouble <= RANGE_H_MAX)){
+				double diff = humidity / 1024.0 - humidityDouble;
+				if (diff < 0) diff = -diff;
+				if (diff > maxDiffH) maxDiffH = diff;
+			}
+		}
+	}
+	return mismatches;
+}
+
+/**
+ * Measures the time of a complete sample (temperature, pressure, humidity).
+ * @param c the calibration values
+ * @param reference 1 for the reference formulas, 0 for the library
+ * @return the time per sample in ns
+ */
+static double benchmark(const BB_BME280_CALIBRATION &c, uint8_t reference){
+	std::vector<int32_t> adc(3 * BENCH_SAMPLES);
+	BB_BME280_COEFFICIENTS coef;
+	volatile uint32_t sink = 0;
+	double best = 0;
+
+	// ADC values of the operating range: 0 .. 65 degC, 800 .. 1100 hPa
+	srand(1);
+	for (uint32_t i = 0; i < BENCH_SAMPLES; i++){
+		adc[3 * i] = 480000 + rand() % 100000;
+		adc[3 * i + 1] = 250000 + rand() % 150000;
+		adc[3 * i + 2] = 20000 + rand() % 30000;
+	}
+	BB_BME280_deriveCoefficients(c, coef);
+	for (uint8_t run = 0; run < BENCH_RUNS; run++){
+		uint32_t sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < BENCH_SAMPLES; i++){
+			int32_t t_fine;
+			if (reference){
+				sum += referenceTemperature(c, adc[3 * i], t_fine);
+				sum += referencePressure32(c, adc[3 * i + 1], t_fine);
+				sum += referenceHumidity(c, adc[3 * i + 2], t_fine);
+			} else {
+				sum += BB_BME280_compensateTemperature(c, coef, adc[3 * i], t_fine);
+				sum += BB_BME280_compensatePressure(c, coef, adc[3 * i + 1], t_fine);
+				sum += BB_BME280_compensateHumidity(c, coef, adc[3 * i + 2], t_fine);
+			}
+		}
+		auto stop = std::chrono::steady_clock::now();
+		sink = sink + sum;
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count() / BENCH_SAMPLES;
+		if ((run == 0) || (ns < best)) best = ns;
+	}
+	return best;
+}
+
+/**
+ * Sweeps the ADC space with one calibration and prints the result.
+ * @param name the name of the calibration
+ * @param c the calibration values
+ * @param samples counts the compared values
+ * @return the number of failures
+ */
+static uint32_t check(const char *name, const BB_BME280_CALIBRATION &c, uint32_t &samples){
+	uint32_t count = 0;
+	uint32_t maxDiff64 = 0;
+	double maxDiffH = 0;
+	uint32_t m = sweep(c, count, maxDiff64, maxDiffH);
+
+	printf("%s: %lu values, %lu mismatches (32 bit), max. difference %lu Pa (64 bit), %.3f %%RH (floating point)\n",
+	       name, (unsigned long) count, (unsigned long) m, (unsigned long) maxDiff64, maxDiffH);
+	samples += count;
+	if (maxDiffH > RANGE_H_DIFF) m++;
+	return m;
+}
+
+int main(void){
+	BB_BME280_CALIBRATION parsed;
+	uint32_t mismatches = 0;
+	uint32_t samples = 0;
+	char name[16];
+
+	for (uint8_t n = 0; n < CALIBRATIONS; n++){
+		snprintf(name, sizeof(name), "calibration %u", n);
+		mismatches += check(name, calibrations[n], samples);
+	}
+
+	// the calibration registers with negative dig_H4 / dig_H5
+	memset(&parsed, 0, sizeof(parsed));
+	BB_BME280_parseCalibration(registersTp, registersH, parsed);
+	if ((parsed.dig_T1 != registersCalibration.dig_T1) || (parsed.dig_T2 != registersCalibration.dig_T2) ||
+	    (parsed.dig_T3 != registersCalibration.dig_T3) || (parsed.dig_P1 != registersCalibration.dig_P1) ||
+	    (parsed.dig_P2 != registersCalibration.dig_P2) || (parsed.dig_P3 != registersCalibration.dig_P3) ||
+	    (parsed.dig_P4 != registersCalibration.dig_P4) || (parsed.dig_P5 != registersCalibration.dig_P5) ||
+	    (parsed.dig_P6 != registersCalibration.dig_P6) || (parsed.dig_P7 != registersCalibration.dig_P7) ||
+	    (parsed.dig_P8 != registersCalibration.dig_P8) || (parsed.dig_P9 != registersCalibration.dig_P9) ||
+	    (parsed.dig_H1 != registersCalibration.dig_H1) || (parsed.dig_H2 != registersCalibration.dig_H2) ||
+	    (parsed.dig_H3 != registersCalibration.dig_H3) || (parsed.dig_H4 != registersCalibration.dig_H4) ||
+	    (parsed.dig_H5 != registersCalibration.dig_H5) || (parsed.dig_H6 != registersCalibration.dig_H6)){
+		printf("registers: conversion failed, dig_H4 %d dig_H5 %d\n", parsed.dig_H4, parsed.dig_H5);
+		mismatches++;
+	} else {
+		printf("registers: dig_H3 %u dig_H4 %d dig_H5 %d\n", parsed.dig_H3, parsed.dig_H4, parsed.dig_H5);
+	}
+	mismatches += check("registers", parsed, samples);
+	printf("total: %lu values, %lu mismatches\n", (unsigned long) samples, (unsigned long) mismatches);
+
+	for (uint8_t n = 0; n < CALIBRATIONS; n++){
+		double library = benchmark(calibrations[n], 0);
+		double reference = benchmark(calibrations[n], 1);
+		printf("calibration %u: library %.1f ns/sample, reference %.1f ns/sample\n", n, library, reference);
+	}
+	return mismatches ? 1 : 0;
+}
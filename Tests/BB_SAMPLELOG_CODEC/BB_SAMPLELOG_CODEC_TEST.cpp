@@ -0,0 +1,362 @@
+/*
+ * BB_SAMPLELOG_CODEC_TEST.cpp - Host test of the sample log codec.
+ * Checks the round trip of keyframes and delta records, the header bits
+ * (skipped fields, extended header with status and sequence difference),
+ * negative and large differences at the limits of the zigzag / varint
+ * packing, the wrap around of the sequence and of the values, and that
+ * truncated or malformed data is rejected without changing the record.
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: E. Mittermeier, BlueberryE
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BB_SAMPLELOG_CODEC.h"
+
+// number of records of the random sequence, a keyframe every RANDOM_KEYFRAME records
+#define RANDOM_RECORDS 200000
+#define RANDOM_KEYFRAME 12
+
+static uint32_t failures = 0;
+
+/**
+ * Reports a failed check.
+ */
+static void fail(const char *name, const char *what){
+	if (failures++ < 20) printf("  %s: %s\n", name, what);
+}
+
+static int equal(const BB_SAMPLELOG_RECORD &a, const BB_SAMPLELOG_RECORD &b){
+	return (a.sequence == b.sequence) && (a.temperature == b.temperature) &&
+	       (a.pressure == b.pressure) && (a.humidity == b.humidity) &&
+	       (a.lux == b.lux) && (a.uvLevel == b.uvLevel) && (a.supply == b.supply) &&
+	       (a.mcuTemperature == b.mcuTemperature) && (a.status == b.status);
+}
+
+/**
+ * Encodes a record, decodes it and compares the result. All shorter
+ * prefixes of the encoded record have to be rejected without changing the
+ * record of the decoder.
+ * @param name the name of the check
+ * @param record the record to be encoded
+ * @param previous the previous record, 0 for a keyframe
+ * @param header the expected first byte, -1 if not checked
+ * @param size the expected size of the encoded record, 0 if not checked
+ * @return the size of the encoded record
+ */
+static uint8_t roundtrip(const char *name, const BB_SAMPLELOG_RECORD &record,
+                         const BB_SAMPLELOG_RECORD *previous, int16_t header, uint8_t size){
+	uint8_t data[BB_SAMPLELOG_CODEC_MAX_SIZE + 8];
+	BB_SAMPLELOG_RECORD start;
+	BB_SAMPLELOG_RECORD decoded;
+	uint8_t n;
+
+	// a keyframe does not depend on the record of the decoder
+	if (previous){
+		start = *previous;
+	} else {
+		memset(&start, 0x5A, sizeof(start));
+	}
+
+	memset(data, 0xEE, sizeof(data));
+	n = BB_SAMPLELOG_encode(record, previous, data);
+	if (n > BB_SAMPLELOG_CODEC_MAX_SIZE) fail(name, "longer than BB_SAMPLELOG_CODEC_MAX_SIZE");
+	if ((header >= 0) && (data[0] != (uint8_t) header)) fail(name, "unexpected header");
+	if ((size > 0) && (n != size)) fail(name, "unexpected size");
+
+	decoded = start;
+	if (BB_SAMPLELOG_decode(data, n, decoded) != n) fail(name, "decoded size differs");
+	if (!equal(decoded, record)) fail(name, "decoded record differs");
+
+	// trailing bytes (the next record) are not consumed
+	decoded = start;
+	if (BB_SAMPLELOG_decode(data, sizeof(data), decoded) != n) fail(name, "trailing data consumed");
+
+	for (uint8_t len = 0; len < n; len++){
+		decoded = start;
+		if (BB_SAMPLELOG_decode(data, len, decoded) != 0) fail(name, "truncated record accepted");
+		if (memcmp(&decoded, &start, sizeof(start)) != 0) fail(name, "record changed by a truncated record");
+	}
+	return n;
+}
+
+static BB_SAMPLELOG_RECORD typical(void){
+	BB_SAMPLELOG_RECORD r;
+	r.sequence = 100;
+	r.temperature = 2150;
+	r.pressure = 101325;
+	r.humidity = 4500;
+	r.lux = 30000;
+	r.uvLevel = 310;
+	r.supply = 3300;
+	r.mcuTemperature = 251;
+	r.status = 0x3F;
+	return r;
+}
+
+static void checkKeyframes(void){
+	BB_SAMPLELOG_RECORD r = typical();
+	BB_SAMPLELOG_RECORD zero;
+
+	roundtrip("keyframe", r, 0, BB_SAMPLELOG_CODEC_KEYFRAME, 0);
+
+	memset(&zero, 0, sizeof(zero));
+	// header, status and one byte per field
+	roundtrip("keyframe zero", zero, 0, BB_SAMPLELOG_CODEC_KEYFRAME, 10);
+
+	// the largest record: 3 bytes per 16 bit and 5 bytes per 32 bit value
+	r.sequence = 0xFFFF;
+	r.temperature = -32768;
+	r.pressure = 0xFFFFFFFFUL;
+	r.humidity = 0xFFFF;
+	r.lux = 0xFFFFFFFFUL;
+	r.uvLevel = 0xFFFF;
+	r.supply = 0xFFFF;
+	r.mcuTemperature = 32767;
+	r.status = 0xFF;
+	roundtrip("keyframe maximum", r, 0, BB_SAMPLELOG_CODEC_KEYFRAME, BB_SAMPLELOG_CODEC_MAX_SIZE);
+}
+
+static void checkDeltas(void){
+	BB_SAMPLELOG_RECORD p = typical();
+	BB_SAMPLELOG_RECORD r;
+
+	// nothing changed but the sequence: the header only
+	r = p;
+	r.sequence++;
+	roundtrip("delta unchanged", r, &p, 0x00, 1);
+
+	// one field each, +1 and -1 take one byte
+	r = p;
+	r.sequence++;
+	r.temperature--;
+	roundtrip("delta temperature", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 2);
+	r = p;
+	r.sequence++;
+	r.pressure++;
+	roundtrip("delta pressure", r, &p, BB_SAMPLELOG_CODEC_PRESSURE, 2);
+	r = p;
+	r.sequence++;
+	r.humidity--;
+	roundtrip("delta humidity", r, &p, BB_SAMPLELOG_CODEC_HUMIDITY, 2);
+	r = p;
+	r.sequence++;
+	r.lux++;
+	roundtrip("delta lux", r, &p, BB_SAMPLELOG_CODEC_LUX, 2);
+	r = p;
+	r.sequence++;
+	r.uvLevel--;
+	roundtrip("delta uv", r, &p, BB_SAMPLELOG_CODEC_UV, 2);
+	// supply and MCU temperature are stored together
+	r = p;
+	r.sequence++;
+	r.supply++;
+	roundtrip("delta supply", r, &p, BB_SAMPLELOG_CODEC_MCU, 3);
+	r = p;
+	r.sequence++;
+	r.mcuTemperature--;
+	roundtrip("delta mcu temperature", r, &p, BB_SAMPLELOG_CODEC_MCU, 3);
+
+	// the limits of one and two varint bytes: zigzag(-64) = 127, zigzag(64) = 128
+	r = p;
+	r.sequence++;
+	r.temperature -= 64;
+	roundtrip("delta -64", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 2);
+	r.temperature = p.temperature + 64;
+	roundtrip("delta +64", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 3);
+	r.temperature = p.temperature - 8192;
+	roundtrip("delta -8192", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 3);
+	r.temperature = p.temperature + 8192;
+	roundtrip("delta +8192", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 4);
+}
+
+static void checkLargeDeltas(void){
+	BB_SAMPLELOG_RECORD p = typical();
+	BB_SAMPLELOG_RECORD r;
+
+	// the largest differences: -32768 / 0x80000000 (zigzag 0xFFFF / 0xFFFFFFFF)
+	p.temperature = 16384;
+	r = p;
+	r.sequence++;
+	r.temperature = -16384;
+	roundtrip("delta -32768", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 4);
+	r.temperature = 32767;
+	p.temperature = -1;
+	roundtrip("delta temperature overflow", r, &p, BB_SAMPLELOG_CODEC_TEMPERATURE, 4);
+
+	p = typical();
+	p.pressure = 0;
+	r = p;
+	r.sequence++;
+	r.pressure = 0x80000000UL;
+	roundtrip("delta 0x80000000", r, &p, BB_SAMPLELOG_CODEC_PRESSURE, 6);
+	r.pressure = 0xFFFFFFFFUL;
+	roundtrip("delta pressure wrap", r, &p, BB_SAMPLELOG_CODEC_PRESSURE, 2);
+
+	// all fields at their extremes
+	p = typical();
+	p.temperature = 32767;
+	p.pressure = 0;
+	p.humidity = 0;
+	p.lux = 0xFFFFFFFFUL;
+	p.uvLevel = 0xFFFF;
+	p.supply = 0;
+	p.mcuTemperature = -32768;
+	r = p;
+	r.sequence++;
+	r.temperature = -32768;
+	r.pressure = 0x7FFFFFFFUL;
+	r.humidity = 0x8000;
+	r.lux = 0x7FFFFFFFUL;
+	r.uvLevel = 0x7FFF;
+	r.supply = 0x8000;
+	r.mcuTemperature = 32767;
+	roundtrip("delta extremes", r, &p, 0x3F, 0);
+	r.sequence += 0x8000;
+	r.status = 0;
+	roundtrip("delta extremes extended", r, &p, 0x7F, 0);
+}
+
+static void checkExtended(void){
+	BB_SAMPLELOG_RECORD p = typical();
+	BB_SAMPLELOG_RECORD r;
+
+	// status changed: status and sequence difference 1 follow
+	r = p;
+	r.sequence++;
+	r.status = 0x37;
+	roundtrip("extended status", r, &p, BB_SAMPLELOG_CODEC_EXTENDED, 3);
+
+	// samples skipped
+	r = p;
+	r.sequence += 5;
+	roundtrip("extended gap", r, &p, BB_SAMPLELOG_CODEC_EXTENDED, 3);
+
+	// same sequence and a sequence going back (modulo 65536)
+	r = p;
+	roundtrip("extended repeat", r, &p, BB_SAMPLELOG_CODEC_EXTENDED, 3);
+	r.sequence -= 3;
+	roundtrip("extended back", r, &p, BB_SAMPLELOG_CODEC_EXTENDED, 5);
+
+	// together with fields
+	r = p;
+	r.sequence += 2;
+	r.status = 0;
+	r.lux += 1000;
+	roundtrip("extended with lux", r, &p, BB_SAMPLELOG_CODEC_EXTENDED | BB_SAMPLELOG_CODEC_LUX, 5);
+}
+
+static void checkSequenceWrap(void){
+	BB_SAMPLELOG_RECORD p = typical();
+	BB_SAMPLELOG_RECORD r;
+
+	// 65535 -> 0 is an increment by 1
+	p.sequence = 0xFFFF;
+	r = p;
+	r.sequence = 0;
+	roundtrip("sequence wrap", r, &p, 0x00, 1);
+
+	// a gap across the wrap around
+	r.sequence = 2;
+	roundtrip("sequence wrap gap", r, &p, BB_SAMPLELOG_CODEC_EXTENDED, 3);
+
+	// a chain of records decoded one after the other
+	BB_SAMPLELOG_RECORD decoded = p;
+	uint8_t data[BB_SAMPLELOG_CODEC_MAX_SIZE];
+	for (uint8_t i = 0; i < 4; i++){
+		r = p;
+		r.sequence++;
+		r.temperature += 3;
+		uint8_t n = BB_SAMPLELOG_encode(r, &p, data);
+		if ((BB_SAMPLELOG_decode(data, n, decoded) != n) || !equal(decoded, r)){
+			fail("sequence wrap chain", "decoded record differs");
+		}
+		p = r;
+	}
+	if (decoded.sequence != 3) fail("sequence wrap chain", "unexpected sequence");
+}
+
+static void checkMalformed(void){
+	BB_SAMPLELOG_RECORD start = typical();
+	BB_SAMPLELOG_RECORD decoded;
+
+	// a varint longer than 5 bytes
+	const uint8_t tooLong[] = {BB_SAMPLELOG_CODEC_PRESSURE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+	decoded = start;
+	if (BB_SAMPLELOG_decode(tooLong, sizeof(tooLong), decoded) != 0) fail("malformed", "long varint accepted");
+	if (memcmp(&decoded, &start, sizeof(start)) != 0) fail("malformed", "record changed by a long varint");
+
+	// the header of a keyframe only
+	const uint8_t header[] = {BB_SAMPLELOG_CODEC_KEYFRAME};
+	decoded = start;
+	if (BB_SAMPLELOG_decode(header, sizeof(header), decoded) != 0) fail("malformed", "keyframe header accepted");
+	if (memcmp(&decoded, &start, sizeof(start)) != 0) fail("malformed", "record changed by a keyframe header");
+}
+
+/**
+ * Random records: slowly changing values (the typical log) alternate with
+ * random values and a keyframe every RANDOM_KEYFRAME records.
+ * @return the average size of the slowly changing delta records
+ */
+static double checkRandom(void){
+	BB_SAMPLELOG_RECORD p = typical();
+	BB_SAMPLELOG_RECORD r;
+	uint32_t total = 0;
+	uint32_t count = 0;
+	char name[32];
+
+	srand(1);
+	p.sequence = 65000;
+	for (uint32_t i = 0; i < RANDOM_RECORDS; i++){
+		uint8_t keyframe = (i % RANDOM_KEYFRAME) == 0;
+		uint8_t slow = (i % 1000) < 500;
+
+		r = p;
+		if (slow){
+			r.sequence++;
+			r.temperature += rand() % 5 - 2;
+			r.pressure += rand() % 21 - 10;
+			r.humidity += rand() % 7 - 3;
+			r.lux += rand() % 9 - 4;
+			if (rand() % 4 == 0) r.uvLevel += rand() % 3 - 1;
+			r.supply += rand() % 5 - 2;
+			if (rand() % 8 == 0) r.mcuTemperature += rand() % 3 - 1;
+		} else {
+			r.sequence = (uint16_t) rand();
+			r.temperature = (int16_t) rand();
+			r.pressure = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+			r.humidity = (uint16_t) rand();
+			r.lux = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+			r.uvLevel = (uint16_t) rand();
+			r.supply = (uint16_t) rand();
+			r.mcuTemperature = (int16_t) rand();
+			r.status = (uint8_t) rand();
+		}
+		snprintf(name, sizeof(name), "random %lu", (unsigned long) i);
+		uint8_t n = roundtrip(name, r, keyframe ? 0 : &p, -1, 0);
+		if (slow && !keyframe){
+			total += n;
+			count++;
+		}
+		p = r;
+	}
+	return (double) total / count;
+}
+
+int main(void){
+	checkKeyframes();
+	checkDeltas();
+	checkLargeDeltas();
+	checkExtended();
+	checkSequenceWrap();
+	checkMalformed();
+	double average = checkRandom();
+
+	printf("random: %u records, %.2f bytes per slowly changing delta record\n", RANDOM_RECORDS, average);
+	printf("total: %lu failures\n", (unsigned long) failures);
+	return failures ? 1 : 0;
+}